@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <climits>
+
+#include <CameraReader/CameraReader/camera_group.hpp>
+
+using namespace std;
+using namespace cv;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		CCameraGroup::CCameraGroup(int max_wait_ms) : max_wait_ms_(max_wait_ms)
+		{
+		}
+
+		CCameraGroup::~CCameraGroup()
+		{
+			for (auto& member : members_)
+				if (member->subscription >= 0)
+					member->reader->Unsubscribe(member->subscription);
+		}
+
+		size_t CCameraGroup::Add(CCamCapReader& reader)
+		{
+			unique_ptr<Member> member(new Member);
+			member->reader = &reader;
+			member->usb_reader = &reader;
+			member->subscription = -1;
+			if (reader.capture_mode_ != CAPTURE_ON_DEMAND)
+				Follow(*member);
+			members_.push_back(move(member));
+			return members_.size() - 1;
+		}
+
+		size_t CCameraGroup::Add(CWebCamReader& reader)
+		{
+			unique_ptr<Member> member(new Member);
+			member->reader = &reader;
+			member->usb_reader = NULL;
+			member->subscription = -1;
+			Follow(*member);
+			members_.push_back(move(member));
+			return members_.size() - 1;
+		}
+
+		void CCameraGroup::Follow(Member& member)
+		{
+			Member* target = &member;
+			member.subscription = member.reader->Subscribe([this, target](const Frame& frame)
+			{
+				{
+					lock_guard<mutex> guard(history_lock_);
+					target->history.push_back(frame);
+					if (target->history.size() > HISTORY_LEN)
+						target->history.pop_front();
+				}
+				new_frame_.notify_all();
+			});
+		}
+
+		bool CCameraGroup::PickNearest(Member& member, long long timestamp, const chrono::steady_clock::time_point& deadline,
+			Mat& frame, long long& frame_timestamp)
+		{
+			unique_lock<mutex> guard(history_lock_);
+			new_frame_.wait_until(guard, deadline, [&member, timestamp]
+			{
+				return !member.history.empty() && member.history.back().info.capture_tick >= timestamp;
+			});
+			if (member.history.empty())
+				return false;
+
+			auto nearest = member.history.begin();
+			for (auto it = member.history.begin(); it != member.history.end(); ++it)
+				if (llabs(it->info.capture_tick - timestamp) < llabs(nearest->info.capture_tick - timestamp))
+					nearest = it;
+			const Frame picked = *nearest;
+			guard.unlock();
+
+			// Only the picked frames of a batch are worth converting, and not while holding up the other cameras.
+			Convert(picked, frame, picked.info.format == PIXEL_PACKED ? picked.image.channels() : 4);
+			frame_timestamp = picked.info.capture_tick;
+			return true;
+		}
+
+		bool CCameraGroup::Grab(FrameBatch& batch)
+		{
+			const size_t member_cnt = members_.size();
+			batch.frames.assign(member_cnt, Mat());
+			batch.timestamps.assign(member_cnt, 0);
+			batch.skew_ms = 0;
+
+			// Take the devices grabbed here in the order of their IDs, so that groups sharing devices cannot deadlock.
+			vector<size_t> direct;
+			for (size_t i = 0; i < member_cnt; ++i)
+				if (members_[i]->subscription < 0)
+					direct.push_back(i);
+			sort(direct.begin(), direct.end(), [this](size_t a, size_t b)
+			{
+				return members_[a]->usb_reader->usb_camera_device_ < members_[b]->usb_reader->usb_camera_device_;
+			});
+
+			vector<size_t> locked;
+			// Members reading a device already taken by another member, with the index of that member.
+			vector<pair<size_t, size_t> > shared;
+			for (size_t i : direct)
+			{
+				CCamCapReader* usb_reader = members_[i]->usb_reader;
+				if (!locked.empty() && members_[locked.back()]->usb_reader->usb_camera_device_ == usb_reader->usb_camera_device_)
+					shared.push_back(make_pair(i, locked.back()));
+				else if (usb_reader->LockCapture())
+					locked.push_back(i);
+				else
+					// Another reader started the background grab thread of the device.
+					Follow(*members_[i]);
+			}
+
+			// Trigger every sensor before decoding anything, so that decoding adds nothing to the skew.
+			vector<bool> grabbed(member_cnt, false);
+			for (size_t i : locked)
+			{
+				grabbed[i] = members_[i]->usb_reader->Grab();
+				batch.timestamps[i] = getTickCount();
+			}
+			for (size_t i : locked)
+			{
+				if (grabbed[i])
+					members_[i]->usb_reader->Retrieve(batch.frames[i]);
+				members_[i]->usb_reader->UnlockCapture();
+			}
+			for (auto& share : shared)
+			{
+				batch.frames[share.first] = batch.frames[share.second];
+				batch.timestamps[share.first] = batch.timestamps[share.second];
+			}
+
+			long long reference = 0;
+			int reference_cnt = 0;
+			for (size_t i : locked)
+			{
+				if (!batch.frames[i].empty())
+				{
+					reference += batch.timestamps[i];
+					++reference_cnt;
+				}
+			}
+
+			const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(max_wait_ms_);
+			if (reference_cnt)
+				reference /= reference_cnt;
+			else
+			{
+				// Nothing was grabbed here: align on the newest moment every followed camera has a frame for.
+				reference = LLONG_MAX;
+				unique_lock<mutex> guard(history_lock_);
+				for (auto& member : members_)
+				{
+					if (member->subscription < 0)
+						continue;
+					Member* target = member.get();
+					new_frame_.wait_until(guard, deadline, [target] { return !target->history.empty(); });
+					if (!member->history.empty())
+						reference = min(reference, member->history.back().info.capture_tick);
+				}
+			}
+
+			for (size_t i = 0; i < member_cnt; ++i)
+				if (members_[i]->subscription >= 0)
+					PickNearest(*members_[i], reference, deadline, batch.frames[i], batch.timestamps[i]);
+
+			bool complete = true;
+			long long earliest = LLONG_MAX, latest = LLONG_MIN;
+			for (size_t i = 0; i < member_cnt; ++i)
+			{
+				if (batch.frames[i].empty())
+				{
+					complete = false;
+					continue;
+				}
+				earliest = min(earliest, batch.timestamps[i]);
+				latest = max(latest, batch.timestamps[i]);
+			}
+			if (earliest <= latest)
+				batch.skew_ms = (latest - earliest) * 1000. / getTickFrequency();
+
+			return complete;
+		}
+	}
+}
@@ -0,0 +1,130 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file camera_group.hpp
+ *	@brief Grabbing one batch of frames from several cameras at once.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <CameraReader/CameraReader/camera_reader.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@struct FrameBatch
+		 *	@brief Frames taken from the cameras of a group as close together in time as possible.
+		 */
+		struct FrameBatch
+		{
+			//! One frame per camera, in the order the cameras were added to the group.
+			std::vector<cv::Mat> frames;
+			//! When each frame was taken, in cv::getTickCount() ticks.
+			std::vector<long long> timestamps;
+			//! Time between the earliest and the latest frame of the batch, in milliseconds.
+			double skew_ms;
+		};
+
+		/*!	@class CCameraGroup
+		 *	@brief Grabs frames from several cameras as one batch.
+		 *
+		 *	Calling GetImage() on each reader in turn adds the full capture latency of every camera to the skew of the batch.
+		 *	Instead, USB cameras grabbed on demand are all triggered with VideoCapture::grab() back-to-back,
+		 *	and only then decoded with VideoCapture::retrieve().
+		 *	Cameras which deliver frames on their own, i.e. web cameras and USB cameras in background grab mode,
+		 *	are followed through a subscription, and the frame nearest in time to the USB ones is picked.
+		 *	Frames are aligned on FrameInfo::capture_tick, so web camera frames count from when they come out of the decoder.
+		 */
+		class CAMERAREADER_API CCameraGroup
+		{
+		public:
+			/*! Constructor of CCameraGroup.
+			 *	@param[in]	max_wait_ms		How long Grab() waits for a followed camera to deliver a frame at least as new as the batch.
+			 */
+			explicit CCameraGroup(int max_wait_ms = 100);
+			/*! Deconstructor of CCameraGroup.
+			 *	Stop following the cameras. The readers must still be alive.
+			 */
+			~CCameraGroup();
+
+			/*! Add a USB camera to the group.
+			 *	@param[in]	reader	The reader of the camera, which must outlive the group.
+			 *	@return				Index of the frames of the camera in each batch.
+			 */
+			size_t Add(CCamCapReader& reader);
+
+			/*! Add a web camera to the group.
+			 *	@param[in]	reader	The reader of the camera, which must outlive the group.
+			 *	@return				Index of the frames of the camera in each batch.
+			 */
+			size_t Add(CWebCamReader& reader);
+
+			/*! Grab one frame from every camera of the group.
+			 *	Frames of followed cameras are shared with their readers and must not be modified in place.
+			 *	@param[out]	batch	Receives the frames, their timestamps and the skew between them.
+			 *	@return				False if some camera gave no frame, which is then left empty in the batch.
+			 */
+			bool Grab(FrameBatch& batch);
+
+		private:
+			//! Number of frames kept for each followed camera to pick from.
+			enum { HISTORY_LEN = 4 };
+
+			struct Member
+			{
+				CCamReader* reader;
+				//! The USB reader, or NULL for a web camera.
+				CCamCapReader* usb_reader;
+				//! ID of the subscription following the camera, or -1 if the camera is grabbed directly.
+				int subscription;
+				//! Latest frames delivered by the camera, oldest first, in the pixel format they were delivered in.
+				std::deque<Frame> history;
+			};
+
+			//! Subscribe to the frames delivered by a camera.
+			void Follow(Member& member);
+			/*! Pick the frame of a followed camera nearest to the given time.
+			 *	Waits until the deadline for a frame at least as new as the given time.
+			 *	@return	False if the camera delivered no frame at all.
+			 */
+			bool PickNearest(Member& member, long long timestamp, const std::chrono::steady_clock::time_point& deadline,
+				cv::Mat& frame, long long& frame_timestamp);
+
+			int max_wait_ms_;
+			std::vector<std::unique_ptr<Member> > members_;
+
+			//! Guards the history of every member.
+			std::mutex history_lock_;
+			std::condition_variable new_frame_;
+		};
+	}
+}
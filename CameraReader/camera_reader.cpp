@@ -1,15 +1,30 @@
 #include <ctime>
 #include <cmath>
 #include <algorithm>
-#include <map>
 #include <cstdlib>
+#include <cstring>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <random>
 #include <unordered_map>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <CameraReader/CameraReader/camera_reader.hpp>
+#include <CameraReader/CameraReader/decode_scheduler.hpp>
+#include <CameraReader/CameraReader/frame_hub.hpp>
+#include <CameraReader/CameraReader/frame_ring.hpp>
+#include <CameraReader/CameraReader/jitter_meter.hpp>
+#include <CameraReader/CameraReader/latency_histogram.hpp>
+#include <CameraReader/CameraReader/logger.hpp>
+#include <CameraReader/CameraReader/packet_queue.hpp>
+#include <CameraReader/CameraReader/resize_yuv.hpp>
+#include <CameraReader/CameraReader/slot_table.hpp>
+#include <CameraReader/CameraReader/stall_watchdog.hpp>
 
 #ifdef _NO_HKSDK
 #define CODEC "h264"
@@ -38,6 +53,7 @@
 //! Pause and wait for a key.
 #define PAUSE getc(stdin)
 #include <unistd.h>
+#include <dirent.h>
 //! Get the running directory.
 #define GETCWD(buf,size) getcwd(buf,size)
 //! Sleep for x milliseconds.
@@ -56,167 +72,1095 @@ namespace Theia
 {
 	namespace Camera
 	{
+		struct CCamReader::DeliveryState
+		{
+			//! Frames waiting for GetImage() when the frame queue is enabled.
+			CFrameRing<Frame> frame_ring;
+
+			//! Guards the callbacks and the pending futures.
+			mutex lock;
+			//! Subscribed callbacks with their IDs.
+			vector<pair<int, FrameCallback> > callbacks;
+			//! Futures waiting for the next frame.
+			vector<promise<Frame> > promises;
+			//! ID of the last subscribed callback.
+			int next_callback_id;
+
+			//! Latency of each stage, indexed by ReaderStage. The one of STAGE_BALANCE is unused.
+			CLatencyHistogram latency[STAGE_CNT];
+			atomic<unsigned long long> frames_produced;
+			atomic<unsigned long long> frames_returned;
+			atomic<unsigned long long> frames_skipped;
+			atomic<unsigned long long> input_retries;
+			atomic<unsigned long long> decode_errors;
+			atomic<unsigned long long> packets_dropped;
+			atomic<unsigned long long> reconnects;
+			//! When the counters were last reset, in cv::getTickCount() ticks.
+			atomic<long long> stats_start_tick;
+			//! Loss and jitter of the stream, fed by readers of live streams.
+			CJitterMeter jitter;
+
+			//! When the newest frame was captured, in cv::getTickCount() ticks, or 0 if none was.
+			atomic<long long> newest_tick;
+			//! Guards the registration with the stall watchdog.
+			mutex watch_lock;
+			//! The watchdog checking the reader, if SetFreshnessSlo() is on.
+			shared_ptr<CStallWatchdog> watchdog;
+			int watch_id;
+			//! Maximum age of the newest frame in milliseconds, 0 if the reader is not watched.
+			atomic<int> slo_ms;
+			//! When the watchdog started checking, which stands in for the newest frame until one is captured.
+			atomic<long long> watch_start_tick;
+			//! When the current stall started, or 0 if the reader is not stalled.
+			atomic<long long> stall_start_tick;
+			//! When to recover the reader again if the stall goes on. Only used by the watchdog.
+			long long next_recover_tick;
+			//! Number of times the reader was recovered during the current stall. Only used by the watchdog.
+			int recover_attempt;
+			atomic<unsigned long long> stalls;
+			//! Milliseconds spent in stalls which are over.
+			atomic<long long> stalled_ms;
+			atomic<long long> longest_stall_ms;
+
+			//! Keeps the log printed while the reader exists.
+			shared_ptr<CLogger> logger;
+
+			DeliveryState() : next_callback_id(0), newest_tick(0), watch_id(0), slo_ms(0), watch_start_tick(0), stall_start_tick(0),
+				next_recover_tick(0), recover_attempt(0), logger(CLogger::Acquire())
+			{
+				ResetCounters();
+			}
+
+			void ResetCounters()
+			{
+				frames_produced = frames_returned = frames_skipped = input_retries = decode_errors = packets_dropped = reconnects = 0;
+				stalls = 0;
+				stalled_ms = longest_stall_ms = 0;
+				jitter.Reset();
+				stats_start_tick = getTickCount();
+			}
+		};
+
+		//! Latency of Balance(), which is not tied to a reader.
+		CLatencyHistogram g_balance_latency;
+		//! When g_balance_latency started counting, in cv::getTickCount() ticks.
+		const long long g_balance_start_tick = getTickCount();
+
+#ifndef _NO_HKSDK
+		//! Bytes of stream data each web camera buffers between the network thread of the SDK and the decode workers.
+		const size_t PACKET_ARENA_SIZE = 4 << 20;
+		//! Number of stream packets each web camera buffers between the network thread of the SDK and the decode workers.
+		const size_t MAX_PACKETS = 2048;
+		//! Number of packets a decode worker feeds to one player before turning to its other streams.
+		const int PACKETS_PER_TURN = 64;
+		//! Maximum number of web cameras playing at once, as many as the SDK can log in.
+		const size_t MAX_CLIENTS = 2048;
+
+		// Integer types of the decode callback, which differ between the Windows and the Linux player.
+#ifdef _WIN32
+		typedef long DEC_CB_INT;
+		typedef long DEC_CB_USER;
+#else
+		typedef int DEC_CB_INT;
+		typedef void* DEC_CB_USER;
+#endif
+#endif
+
+		//! Delay before the first attempt to connect a dropped stream again.
+		const int RECONNECT_MIN_MS = 500;
+		//! Longest delay between attempts to connect a dropped stream again.
+		const int RECONNECT_MAX_MS = 30000;
+
+		/*! Randomizes the delays between attempts to connect dropped streams again, seeded once for all of them.
+		 *	Shared under a lock, as the toolset has no thread_local, nor thread-safe initialization of local statics.
+		 */
+		minstd_rand g_reconnect_rng(random_device{}());
+		mutex g_reconnect_rng_lock;
+
+		/*! Delay before the given attempt to connect a dropped stream again, in milliseconds.
+		 *	It doubles with each attempt up to RECONNECT_MAX_MS, and is randomized between half and all of that,
+		 *	so that the cameras dropped by one network failure do not all reconnect at the same time.
+		 */
+		int ReconnectDelayMs(int attempt)
+		{
+			const int delay_ms = min(RECONNECT_MIN_MS << min(attempt, 16), RECONNECT_MAX_MS);
+			lock_guard<mutex> guard(g_reconnect_rng_lock);
+			return uniform_int_distribution<int>(delay_ms / 2, delay_ms)(g_reconnect_rng);
+		}
+
+		/*!	@class CSharedSetting
+		 *	@brief A setting global to the process, which a login applies before connecting and relies on until it is connected,
+		 *	such as the connect timeout of the SDK or the capture options of FFmpeg.
+		 *
+		 *	Logins wanting the value in place connect at once, so that LoginAll() stays parallel,
+		 *	while a login wanting another value waits for them to finish before changing it.
+		 */
+		template <typename T>
+		class CSharedSetting
+		{
+		public:
+			explicit CSharedSetting(const function<void(const T&)>& apply) : apply_(apply), applied_(false), users_(0) {}
+
+			/*!	@class CUse
+			 *	@brief Holds the setting at a value for as long as it lives.
+			 */
+			class CUse
+			{
+			public:
+				CUse(CSharedSetting& setting, const T& value) : setting_(setting)
+				{
+					unique_lock<mutex> guard(setting_.lock_);
+					setting_.released_.wait(guard, [&] { return setting_.users_ == 0 || setting_.value_ == value; });
+					if (!setting_.applied_ || !(setting_.value_ == value))
+					{
+						setting_.apply_(value);
+						setting_.value_ = value;
+						setting_.applied_ = true;
+					}
+					++setting_.users_;
+				}
+
+				~CUse()
+				{
+					lock_guard<mutex> guard(setting_.lock_);
+					if (--setting_.users_ == 0)
+						setting_.released_.notify_all();
+				}
+
+			private:
+				CSharedSetting& setting_;
+			};
+
+		private:
+			const function<void(const T&)> apply_;
+			mutex lock_;
+			//! Signaled when the last user of the value is done.
+			condition_variable released_;
+			T value_;
+			bool applied_;
+			size_t users_;
+		};
+
+		struct CWebCamReader::StreamState
+		{
+#ifdef _NO_HKSDK
+			//! Guards cap_ between GetImage() and the delivery thread.
+			mutex cap_lock;
+			//! Set while the delivery thread owns cap_.
+			atomic<bool> delivering;
+			//! Grabs from cap_ and delivers each frame once a callback or a future is registered.
+			thread delivery_thread;
+			//! Newest frame grabbed by the delivery thread.
+			CFrameHub hub;
+			//! Sequence number of the last frame returned by GetImage() from the delivery thread.
+			unsigned long long last_seq;
+			//! Number of frames read from cap_.
+			unsigned long long frame_seq;
+			//! Where cap_ was opened, to open it again after the stream drops.
+			string rtsp_url;
+
+			StreamState() : delivering(false), last_seq(0), frame_seq(0) {}
+#else
+			/*! Decode buffers rotated between the decode callback and consumers.
+			 *	Each one holds the YV12 planes of a frame, or with the bitmap fallback,
+			 *	a header row whose tail receives the bitmap headers, followed by the BGRA pixels of a frame.
+			 *	A buffer is decoded into only when no image handed out still refers to it.
+			 */
+			vector<Mat> decode_bufs;
+			//! Index of the decode buffer holding the newest frame, or -1 if none.
+			int latest_buf;
+			//! The newest frame, referring to the pixels in decode_bufs[latest_buf].
+			Frame latest_frame;
+			//! Whether the player hands decoded frames to OnDecodedFrame(), so that no bitmap has to be requested.
+			bool decode_callback;
+			//! Number of the last frame fetched as a bitmap, telling when the player has decoded a new one.
+			DWORD bitmap_frame_num;
+
+			//! Guards the decode buffer and the frame sequence numbers.
+			mutex frame_lock;
+			//! Signaled by the decode callback each time a new frame is decoded.
+			condition_variable frame_ready;
+			//! Sequence number of the newest decoded frame.
+			unsigned long long frame_seq;
+			//! Sequence number of the last frame returned by GetImage().
+			unsigned long long consumed_seq;
+
+			//! Packets handed over by the stream callback, waiting for a decode worker.
+			CPacketQueue packets;
+			//! Workers shared by all web cameras, which feed the packets to the players off the network thread of the SDK.
+			shared_ptr<CDecodeScheduler> scheduler;
+			//! The stream of this camera in scheduler, or NULL while not playing.
+			shared_ptr<CDecodeScheduler::Stream> decode_stream;
+			//! Slot of the camera in g_clients, given to the SDK callbacks as user data, or -1 while not playing.
+			int client_slot;
+			//! The system header the player was opened with, so that it is kept when the same stream comes back.
+			vector<unsigned char> sys_header;
+
+			//! Where Login() logged in, to log in again after the stream drops.
+			string dev_ip;
+			unsigned short dev_port;
+			string username;
+			string passwd;
+			StreamType stream_type;
+			//! The handle of the preview, by which the exception callback finds the camera. -1 while disconnected.
+			atomic<long> play_handle;
+
+			//! Guards the fields below against the exception callback and Logout().
+			mutex reconnect_lock;
+			//! Signaled by Logout() to cut the backoff of reconnect_thread short.
+			condition_variable reconnect_stop;
+			//! Set while logged out, so that dropped streams are not connected again.
+			bool stop_reconnect;
+			//! Set while reconnect_thread runs.
+			bool reconnecting;
+			thread reconnect_thread;
+
+			StreamState() : latest_buf(-1), decode_callback(false), bitmap_frame_num(DWORD(-1)), frame_seq(0), consumed_seq(0),
+				packets(PACKET_ARENA_SIZE, MAX_PACKETS), client_slot(-1), dev_port(0), stream_type(STREAM_MAIN), play_handle(-1),
+				stop_reconnect(true), reconnecting(false) {}
+
+			/*! Receive a decoded frame from the player, without the color conversion of PlayM4_GetBMP().
+			 *	Registered per port by the stream callback, with the slot of the client in g_clients (client_slot) as user data.
+			 */
+			static void CALLBACK OnDecodedFrame(DEC_CB_INT port, char* buf, DEC_CB_INT size, FRAME_INFO* frame_info, DEC_CB_USER user, DEC_CB_INT reserved);
+#endif
+		};
+
 		struct CamCap
 		{
 			int usage_cnt = 0;
 			VideoCapture cap;
 			mutex lock;
+
+			//! Set while the background grab thread owns the capture.
+			atomic<bool> grabbing;
+			//! Background grab thread, running while grabbing is set.
+			thread grab_thread;
+			//! Broadcasts the frames of the background grab thread to the readers of the device.
+			CFrameHub hub;
+			//! Number of frames read from the device.
+			unsigned long long frame_seq = 0;
+
+			//! Opens the device and waits for its first frame, holding lock only while opening it and for each read.
+			thread warm_thread;
+			//! Serializes starting and joining warm_thread, and closing the device once its last reader is gone.
+			mutex warm_thread_lock;
+			//! Guards the warm-up state, and wakes the readers waiting for it.
+			mutex warm_lock;
+			condition_variable warmed;
+			UsbWarmUpState warm_state;
+			//! Set by StartGrabbing() during the warm-up, which then starts the grab thread once the first frame came.
+			bool grab_after_warm;
+			//! Set when the last reader of the device is gone, to end the wait of the warm-up for the first frame.
+			atomic<bool> stop_warm_up;
+			//! The size of the first frame.
+			int width;
+			int height;
+
+			CamCap() : grabbing(false), warm_state(WARM_UP_PENDING), grab_after_warm(false), stop_warm_up(false), width(0), height(0) {}
 		};
-		//! Key is device ID.
+		//! Key is device ID. Readers keep a pointer to their entry, which stays valid as the map grows.
 		unordered_map<int, CamCap> usb_cams_;
-		void ReleaseCap(CamCap& cam_cap)
+		//! Guards usb_cams_ and the usage counts of its entries, as readers may be constructed on any thread.
+		mutex usb_cams_lock;
+		//! How long a USB camera may take to open and send its first frame.
+		const int USB_WARM_UP_MS = 10000;
+
+		//! Milliseconds elapsed since the given cv::getTickCount() ticks.
+		double MsSince(long long tick)
 		{
-			if (!--cam_cap.usage_cnt)
-				cam_cap.cap.release();
+			return (getTickCount() - tick) * 1000. / getTickFrequency();
 		}
-		void InitUSBCap(int usb_camera_device, int max_img_width, int max_img_height)
+
+		/*! Read a frame from a capture, stamping it as soon as it is grabbed.
+		 *	@return	False if no frame was read.
+		 */
+		bool ReadFrame(VideoCapture& cap, Mat& image, FrameInfo& info)
 		{
-			CamCap& cam = usb_cams_[usb_camera_device];
+			if (!cap.grab())
+				return false;
+			info.capture_tick = getTickCount();
+			if (!cap.retrieve(image) || image.empty())
+				return false;
+			info.decode_ms = MsSince(info.capture_tick);
+			return true;
+		}
 
-			if (!cam.usage_cnt)
+		void GrabLoop(CamCap* cam)
+		{
+			while (cam->grabbing)
 			{
-				cam.cap.open(usb_camera_device);
-				Mat test_frame;
+				Frame& frame = cam->hub.BeginWrite();
+				if (!ReadFrame(cam->cap, frame.image, frame.info))
+					SLEEP_MS(1);
+				else
+				{
+					frame.info.seq = ++cam->frame_seq;
+					cam->hub.Publish();
+				}
+			}
+		}
+		void StartGrabbing(CamCap& cam)
+		{
+			{
+				// Grab once the device is warm, which it may be after another try if it failed.
+				lock_guard<mutex> guard(cam.warm_lock);
+				if (cam.warm_state != WARM_UP_READY)
+				{
+					cam.grab_after_warm = true;
+					return;
+				}
+			}
+
+			lock_guard<mutex> guard(cam.lock);
+			if (cam.grabbing)
+				return;
+
+			// Publish one frame before returning, so readers never find the hub empty.
+			Frame& frame = cam.hub.BeginWrite();
+			if (ReadFrame(cam.cap, frame.image, frame.info))
+			{
+				frame.info.seq = ++cam.frame_seq;
+				cam.hub.Publish();
+			}
+
+			cam.grabbing = true;
+			cam.grab_thread = thread(GrabLoop, &cam);
+		}
+		void StopGrabbing(CamCap& cam)
+		{
+			if (!cam.grabbing)
+				return;
+			cam.grabbing = false;
+			cam.hub.Close();
+			cam.grab_thread.join();
+			cam.hub.Reset();
+		}
+		/*! Close and open a device again, e.g. after it stopped sending frames.
+		 *	The background grab thread is restarted if it runs, and its readers keep waiting on the hub meanwhile.
+		 */
+		void ReopenCap(CamCap& cam, int device)
+		{
+			lock_guard<mutex> guard(cam.lock);
+			const bool grabbing = cam.grabbing;
+			if (grabbing)
+			{
+				cam.grabbing = false;
+				cam.grab_thread.join();
+			}
 
-				if (cam.cap.isOpened())
+			const double width = cam.cap.get(CV_CAP_PROP_FRAME_WIDTH);
+			const double height = cam.cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+			cam.cap.release();
+			if (cam.cap.open(device))
+			{
+				cam.cap.set(CV_CAP_PROP_FRAME_WIDTH, width);
+				cam.cap.set(CV_CAP_PROP_FRAME_HEIGHT, height);
+				CLogger::Log(LOG_INFO, "USB camera %lld reopened.", device);
+			}
+			else
+				CLogger::Log(LOG_WARNING, "USB camera %lld cannot be reopened.", device);
+
+			if (grabbing)
+			{
+				cam.grabbing = true;
+				cam.grab_thread = thread(GrabLoop, &cam);
+			}
+		}
+		void ReleaseCap(CamCap& cam_cap)
+		{
+			bool last_user;
+			{
+				lock_guard<mutex> guard(usb_cams_lock);
+				last_user = !--cam_cap.usage_cnt;
+			}
+			if (last_user)
+			{
+				lock_guard<mutex> thread_guard(cam_cap.warm_thread_lock);
 				{
-					cam.cap.set(CV_CAP_PROP_FRAME_WIDTH, max_img_width);
-					cam.cap.set(CV_CAP_PROP_FRAME_HEIGHT, max_img_height);
+					// A new reader may have come meanwhile, and keeps the device.
+					lock_guard<mutex> guard(usb_cams_lock);
+					if (cam_cap.usage_cnt)
+						return;
+				}
+				// Opening the device cannot be cut short, but waiting for its first frame can.
+				cam_cap.stop_warm_up = true;
+				if (cam_cap.warm_thread.joinable())
+					cam_cap.warm_thread.join();
+				StopGrabbing(cam_cap);
+				cam_cap.cap.release();
+			}
+		}
 
-					int failed_times = -1;
-					do
+		/*! Open a device and wait for its first frame, which is published to the readers of the device.
+		 *	Runs on CamCap::warm_thread, so that the readers of many devices are constructed without waiting for each other.
+		 */
+		void WarmUp(CamCap* cam, int usb_camera_device, int max_img_width, int max_img_height)
+		{
+			UsbWarmUpState state = WARM_UP_NOT_FOUND;
+			bool opened;
+			{
+				lock_guard<mutex> guard(cam->lock);
+				opened = cam->cap.open(usb_camera_device);
+				if (opened)
+				{
+					cam->cap.set(CV_CAP_PROP_FRAME_WIDTH, max_img_width);
+					cam->cap.set(CV_CAP_PROP_FRAME_HEIGHT, max_img_height);
+				}
+			}
+			if (opened)
+			{
+				// Cameras send a few empty frames while they adjust, so wait for the first one within a deadline.
+				// The lock is taken for each read only, so that CCameraGroup and on-demand readers are not stalled meanwhile.
+				const long long start_tick = getTickCount();
+				Frame& frame = cam->hub.BeginWrite();
+				bool got_frame = false;
+				while (!cam->stop_warm_up && MsSince(start_tick) < USB_WARM_UP_MS)
+				{
 					{
-						cam.cap >> test_frame;
-						++failed_times;
-						if (failed_times > 1000)
-							throw CCameraNoInputException("The USB camera's input is empty!");
-					} while (test_frame.empty());
+						lock_guard<mutex> guard(cam->lock);
+						got_frame = ReadFrame(cam->cap, frame.image, frame.info);
+						if (got_frame)
+							frame.info.seq = ++cam->frame_seq;
+					}
+					if (got_frame)
+						break;
+					SLEEP_MS(1);
+				}
 
-					cout << "USB camera " << usb_camera_device << " initialized! (" << test_frame.cols << 'x' << test_frame.rows << ')' << endl;
+				if (got_frame)
+				{
+					cam->width = frame.image.cols;
+					cam->height = frame.image.rows;
+					cam->hub.Publish();
+					cout << "USB camera " << usb_camera_device << " initialized! (" << cam->width << 'x' << cam->height << ')' << endl;
+					state = WARM_UP_READY;
 				}
 				else
-					throw CCameraNotFoundException("Cannot find USB camera!");
+					state = WARM_UP_NO_INPUT;
+			}
+
+			bool start_grabbing;
+			{
+				lock_guard<mutex> guard(cam->warm_lock);
+				cam->warm_state = state;
+				start_grabbing = cam->grab_after_warm;
+				cam->grab_after_warm = false;
+			}
+			cam->warmed.notify_all();
+			if (start_grabbing)
+				StartGrabbing(*cam);
+		}
+
+		/*! Start warming up a device, unless it is warming up or warm already.
+		 *	A device which failed to warm up is tried again.
+		 */
+		void StartWarmUp(CamCap& cam, int usb_camera_device, int max_img_width, int max_img_height)
+		{
+			lock_guard<mutex> thread_guard(cam.warm_thread_lock);
+			{
+				lock_guard<mutex> guard(cam.warm_lock);
+				if (cam.warm_thread.joinable() && (cam.warm_state == WARM_UP_PENDING || cam.warm_state == WARM_UP_READY))
+					return;
+				cam.warm_state = WARM_UP_PENDING;
 			}
+			// The last warm-up failed or was stopped, and its thread is done.
+			if (cam.warm_thread.joinable())
+				cam.warm_thread.join();
+			cam.stop_warm_up = false;
+			cam.warm_thread = thread(WarmUp, &cam, usb_camera_device, max_img_width, max_img_height);
+		}
 
+		//! Find or add the capture of a device, and count one more user of it.
+		CamCap& AcquireCap(int usb_camera_device)
+		{
+			lock_guard<mutex> guard(usb_cams_lock);
+			CamCap& cam = usb_cams_[usb_camera_device];
 			++cam.usage_cnt;
+			return cam;
 		}
 
 #ifndef _NO_HKSDK
-		map<DWORD, CWebCamReader*> g_client_list;
+		//! Web cameras by the user data of their SDK callbacks.
+		CSlotTable<CWebCamReader, MAX_CLIENTS> g_clients;
 		int CWebCamReader::g_client_cnt = 0;
 #endif
 
 #ifndef _NO_HKSDK
 		void CALLBACK g_RealDataCallBack_V30(LONG lRealHandle, DWORD dwDataType, BYTE *pBuffer, DWORD dwBufSize, DWORD dwUser)
+		{
+			if (dwDataType != NET_DVR_SYSHEAD && dwDataType != NET_DVR_STREAMDATA || !dwBufSize)
+				return;
+
+			// This runs on a network thread of the SDK, which may serve many streams: only hand the packet over to the decode workers.
+			// Logout() waits for the lookup before freeing the camera.
+			const CSlotTable<CWebCamReader, MAX_CLIENTS>::CLookup client(g_clients, dwUser);
+			CWebCamReader* pClient = client.Get();
+			if (!pClient)
+				return;
+			CWebCamReader::StreamState& stream = *pClient->stream_;
+			if (!stream.packets.Push(dwDataType, pBuffer, dwBufSize))
+			{
+				++pClient->delivery_->packets_dropped;
+				return;
+			}
+			stream.scheduler->Wake(*stream.decode_stream);
+		}
+
+		bool CWebCamReader::InputPackets()
+		{
+			CPacketQueue::Packet packet;
+			int cnt = 0;
+			for (; cnt < PACKETS_PER_TURN && stream_->packets.Front(packet); ++cnt)
+			{
+				// Keep a packet the player cannot take yet for the next turn, and let the worker serve the other streams meanwhile.
+				if (!InputPacket(packet.type, packet.data, packet.size))
+					break;
+				stream_->packets.Pop();
+			}
+			return cnt > 0;
+		}
+
+		bool CWebCamReader::InputPacket(unsigned long type, const unsigned char* data, size_t size)
 		{
 			//HWND hWnd = GetConsoleWindow();
 			const HWND hWnd = NULL;
+			BYTE* pBuffer = const_cast<BYTE*>(data);
+			DWORD dwBufSize = DWORD(size);
 
-			CWebCamReader* pClient = g_client_list[dwUser];
-
-			switch (dwDataType)
+			switch (type)
 			{
 			case NET_DVR_SYSHEAD: //ϵͳͷ
-				if (!PlayM4_GetPort(&pClient->port_))  //ȡſδʹõͨ
-					break;
-				//PlayM4_SetDecodeFrameType(pClient->port_, 1);
-				PlayM4_SkipErrorData(pClient->port_, true);
-				PlayM4_SetDisplayBuf(pClient->port_, 2);
-
-				//m_iPort = pClient->port_; //һλصϵͳͷȡĲſportŸֵȫport´λصʱʹôportŲ
-				if (dwBufSize > 0)
+				if (port_ != -1)
 				{
-					if (!PlayM4_SetStreamOpenMode(pClient->port_, STREAME_REALTIME))  //ʵʱģʽ
+					// Connected again: the same stream goes on in the open player, with its decode callback and buffers.
+					if (stream_->sys_header.size() == size && equal(data, data + size, stream_->sys_header.begin()))
 					{
-						cout << "Error " << PlayM4_GetLastError(pClient->port_) << " occured when setting stream open mode!" << endl;
+						PlayM4_ResetSourceBuffer(port_);
 						break;
 					}
+					// The camera was reconfigured meanwhile: open the port again for the new stream.
+					PlayM4_Stop(port_);
+					PlayM4_CloseStream(port_);
+				}
+				else if (!PlayM4_GetPort(&port_))  //ȡſδʹõͨ
+					break;
+				stream_->sys_header.assign(data, data + size);
+				//PlayM4_SetDecodeFrameType(port_, 1);
+				PlayM4_SkipErrorData(port_, true);
+				PlayM4_SetDisplayBuf(port_, 2);
 
-					if (!PlayM4_OpenStream(pClient->port_, pBuffer, dwBufSize, SOURCE_BUF_MAX)) //ӿ
-					{
-						cout << "Error " << PlayM4_GetLastError(pClient->port_) << " occured when opening stream!" << endl;
-						break;
-					}
+				//m_iPort = port_; //һλصϵͳͷȡĲſportŸֵȫport´λصʱʹôportŲ
+				if (!PlayM4_SetStreamOpenMode(port_, STREAME_REALTIME))  //ʵʱģʽ
+				{
+					CLogger::Log(LOG_ERROR, "Error %lld occured when setting stream open mode!", PlayM4_GetLastError(port_));
+					break;
+				}
 
-					if (!PlayM4_Play(pClient->port_, hWnd)) //ſʼ
-					{
-						cout << "Error " << PlayM4_GetLastError(pClient->port_) << " occured when starting to play!" << endl;
-						break;
-					}
+				if (!PlayM4_OpenStream(port_, pBuffer, dwBufSize, SOURCE_BUF_MAX)) //ӿ
+				{
+					CLogger::Log(LOG_ERROR, "Error %lld occured when opening stream!", PlayM4_GetLastError(port_));
+					break;
+				}
+
+				// Take the decoded YV12 frames as they are, and request bitmaps only if the player refuses.
+				stream_->decode_callback = PlayM4_SetDecCallBackMend(port_, CWebCamReader::StreamState::OnDecodedFrame, (DEC_CB_USER)(size_t)stream_->client_slot) != 0;
+				if (!stream_->decode_callback)
+					CLogger::Log(LOG_WARNING, "Error %lld occured when setting decode callback! Falling back to bitmaps.", PlayM4_GetLastError(port_));
+				stream_->bitmap_frame_num = DWORD(-1);
+
+				if (!PlayM4_Play(port_, hWnd)) //ſʼ
+				{
+					CLogger::Log(LOG_ERROR, "Error %lld occured when starting to play!", PlayM4_GetLastError(port_));
+					break;
 				}
 				break;
 			case NET_DVR_STREAMDATA:   //
-				if (dwBufSize > 0 && pClient->port_ != -1)
+				if (port_ != -1)
 				{
-					pClient->img_prepared_ = false;
-
-					while (!PlayM4_InputData(pClient->port_, pBuffer, dwBufSize))
+					const long long input_tick = getTickCount();
+					while (!PlayM4_InputData(port_, pBuffer, dwBufSize))
 					{
-						if (PlayM4_GetLastError(pClient->port_) != PLAYM4_BUF_OVER && PlayM4_GetLastError(pClient->port_) != PLAYM4_ORDER_ERROR)
+						if (PlayM4_GetLastError(port_) != PLAYM4_BUF_OVER && PlayM4_GetLastError(port_) != PLAYM4_ORDER_ERROR)
 						{
-							cout << "Error " << PlayM4_GetLastError(pClient->port_) << " occured when inputting data!" << endl;
+							CLogger::Log(LOG_ERROR, "Error %lld occured when inputting data!", PlayM4_GetLastError(port_));
+							++delivery_->decode_errors;
 							break;
 						}
-						else if (PlayM4_GetLastError(pClient->port_) == PLAYM4_BUF_OVER)
-						{
-							cout << "Buffer overflow when input data! Retrying after 5ms..." << endl;
-							SLEEP_MS(1);
-						}
-						else
-							cout << "PlayM4 order error! Retrying..." << endl;
+						++delivery_->input_retries;
+						if (PlayM4_GetLastError(port_) == PLAYM4_BUF_OVER)
+							return false;
 					}
+					delivery_->latency[STAGE_INPUT_DATA].RecordSince(input_tick);
 
-					//cout << dwBufSize << endl;
-
-					if (dwBufSize == 20)
+					// Without the decode callback, ask the player after each packet whether it has decoded a new frame,
+					// so that each frame is fetched once and at once, however the camera splits its stream into packets.
+					if (!stream_->decode_callback)
 					{
-						if (!PlayM4_GetBMP(pClient->port_, pClient->decode_buf_, pClient->decode_buf_size_, &dwBufSize))
+						const DWORD frame_num = PlayM4_GetCurrentFrameNum(port_);
+						if (frame_num == stream_->bitmap_frame_num)
+							break;
+						stream_->bitmap_frame_num = frame_num;
+
+						LONG width = default_img_width_, height = default_img_height_;
+						PlayM4_GetPictureSize(port_, &width, &height);
+
+						// The bitmap headers are written at the tail of the header row, so the pixels start exactly at row 1.
+						const int buf_idx = AcquireDecodeBuf(height + 1, width, CV_8UC4);
+						Mat& buf = stream_->decode_bufs[buf_idx];
+						const size_t header_size = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+						PBYTE bmp = buf.data + buf.step - header_size;
+						Frame frame;
+						frame.info.capture_tick = getTickCount();
+						if (!PlayM4_GetBMP(port_, bmp, DWORD(buf.step * buf.rows - (buf.step - header_size)), &dwBufSize))
 						{
-							cout << "Error " << PlayM4_GetLastError(pClient->port_) << " occured when getting bmp!" << endl;
+							CLogger::Log(LOG_ERROR, "Error %lld occured when getting bmp!", PlayM4_GetLastError(port_));
+							++delivery_->decode_errors;
 							break;
 						}
-
-						PlayM4_GetPictureSize(pClient->port_, &pClient->default_img_width_, &pClient->default_img_height_);
-						pClient->img_prepared_ = true;
-
-						SLEEP_MS(10);
+						frame.info.decode_ms = MsSince(frame.info.capture_tick);
+						frame.info.source_frame_num = frame_num;
+						frame.image = buf.rowRange(1, buf.rows);
+						PublishFrame(buf_idx, frame, width, height);
 					}
 				}
 			}
+			return true;
+		}
+
+		void CALLBACK CWebCamReader::StreamState::OnDecodedFrame(DEC_CB_INT port, char* buf, DEC_CB_INT size, FRAME_INFO* frame_info, DEC_CB_USER user, DEC_CB_INT reserved)
+		{
+			const long width = frame_info->nWidth, height = frame_info->nHeight;
+			const size_t frame_size = size_t(width) * height * 3 / 2;
+			if (frame_info->nType != T_YV12 || size_t(size) < frame_size)
+				return;
+
+			const CSlotTable<CWebCamReader, MAX_CLIENTS>::CLookup client(g_clients, size_t(user));
+			CWebCamReader* pClient = client.Get();
+			if (!pClient)
+				return;
+
+			// The player reuses its buffer once we return, so the planes are copied, but never converted.
+			Frame frame;
+			frame.info.capture_tick = getTickCount();
+			const int buf_idx = pClient->AcquireDecodeBuf(int(height * 3 / 2), int(width), CV_8UC1);
+			Mat& planes = pClient->stream_->decode_bufs[buf_idx];
+			memcpy(planes.data, buf, frame_size);
+			frame.info.decode_ms = MsSince(frame.info.capture_tick);
+			frame.info.source_frame_num = frame_info->dwFrameNum;
+			frame.info.format = PIXEL_YV12;
+			pClient->delivery_->jitter.Add(frame.info.capture_tick, frame_info->nStamp, frame_info->nFrameRate);
+			frame.image = planes;
+			pClient->PublishFrame(buf_idx, frame, width, height);
 		}
 #endif
 
+		CCamReader::CCamReader() : frame_timeout_ms_(5000), delivery_(new DeliveryState)
+		{
+		}
+
+		CCamReader::~CCamReader()
+		{
+			SetFreshnessSlo(0);
+		}
+
+		const cv::Mat& CCamReader::GetFreshImage(int max_age_ms, int timeout_ms)
+		{
+			const long long call_tick = getTickCount();
+			for (;;)
+			{
+				// Wait only as long as the caller has left.
+				const Mat& image = GetImageWithin(timeout_ms < 0 ? frame_timeout_ms_ : max(timeout_ms - (int)MsSince(call_tick), 0));
+				if (!image.empty() && MsSince(last_info_.capture_tick) <= max_age_ms)
+					break;
+				if (timeout_ms >= 0 && MsSince(call_tick) >= timeout_ms)
+					return ReturnFrame(Mat(), FrameInfo(), call_tick);
+				// Readers returning the newest frame without waiting, e.g. USB cameras grabbing in the background, would spin here.
+				if (!last_info_.is_new)
+					SLEEP_MS(1);
+			}
+			return img_buf_;
+		}
+
+		void CCamReader::SetFreshnessSlo(int max_age_ms)
+		{
+			{
+				lock_guard<mutex> guard(delivery_->watch_lock);
+				delivery_->slo_ms = max(max_age_ms, 0);
+				if (max_age_ms > 0 && !delivery_->watchdog)
+				{
+					delivery_->watch_start_tick = getTickCount();
+					delivery_->watchdog = CStallWatchdog::Acquire();
+					delivery_->watch_id = delivery_->watchdog->Add([this] { CheckFreshness(); });
+				}
+				else if (max_age_ms <= 0 && delivery_->watchdog)
+				{
+					delivery_->watchdog->Remove(delivery_->watch_id);
+					delivery_->watchdog.reset();
+					delivery_->stall_start_tick = 0;
+				}
+			}
+			if (max_age_ms > 0)
+				StartDelivery();
+		}
+
+		void CCamReader::CheckFreshness()
+		{
+			DeliveryState& state = *delivery_;
+			const int slo_ms = state.slo_ms;
+			if (!slo_ms)
+				return;
+
+			const long long now = getTickCount();
+			const long long newest_tick = state.newest_tick;
+			const double age_ms = MsSince(max(newest_tick, state.watch_start_tick.load()));
+			const long long stall_start_tick = state.stall_start_tick;
+			if (age_ms <= slo_ms)
+			{
+				if (stall_start_tick)
+				{
+					// The stall lasted until the first frame after it was captured.
+					const long long stall_ms = max((long long)((newest_tick - stall_start_tick) * 1000. / getTickFrequency()), 0LL);
+					state.stalled_ms += stall_ms;
+					if (stall_ms > state.longest_stall_ms)
+						state.longest_stall_ms = stall_ms;
+					state.stall_start_tick = 0;
+					CLogger::Log(LOG_INFO, "Reader recovered after a stall of %lld ms.", stall_ms);
+				}
+				return;
+			}
+
+			if (!stall_start_tick)
+			{
+				state.stall_start_tick = now;
+				++state.stalls;
+				state.recover_attempt = 0;
+				CLogger::Log(LOG_WARNING, "Reader stalled: the newest frame is %lld ms old.", (long long)age_ms);
+			}
+			else if (now < state.next_recover_tick)
+				return;
+
+			// Back off like reconnections, so that a camera which is gone does not keep its reader busy.
+			const int delay_ms = max(ReconnectDelayMs(state.recover_attempt++), slo_ms);
+			state.next_recover_tick = now + (long long)(delay_ms * getTickFrequency() / 1000);
+			Recover();
+		}
+
+		void CCamReader::SetFrameQueue(size_t capacity, FrameDropPolicy policy)
+		{
+			delivery_->frame_ring.Reset(capacity, policy);
+		}
+
+		FrameRingStats CCamReader::GetFrameQueueStats()
+		{
+			return delivery_->frame_ring.GetStats();
+		}
+
+		int CCamReader::Subscribe(const FrameCallback& callback)
+		{
+			int id;
+			{
+				lock_guard<mutex> guard(delivery_->lock);
+				id = ++delivery_->next_callback_id;
+				delivery_->callbacks.push_back(make_pair(id, callback));
+			}
+			StartDelivery();
+			return id;
+		}
+
+		void CCamReader::Unsubscribe(int id)
+		{
+			lock_guard<mutex> guard(delivery_->lock);
+			for (auto it = delivery_->callbacks.begin(); it != delivery_->callbacks.end(); ++it)
+			{
+				if (it->first == id)
+				{
+					delivery_->callbacks.erase(it);
+					break;
+				}
+			}
+		}
+
+		future<Frame> CCamReader::GetImageAsync()
+		{
+			future<Frame> result;
+			{
+				lock_guard<mutex> guard(delivery_->lock);
+				delivery_->promises.push_back(promise<Frame>());
+				result = delivery_->promises.back().get_future();
+			}
+			StartDelivery();
+			return result;
+		}
+
+		void CCamReader::DeliverFrame(const Frame& frame)
+		{
+			CountFrame(frame.info);
+			delivery_->frame_ring.Push(frame);
+
+			lock_guard<mutex> guard(delivery_->lock);
+			for (auto& callback : delivery_->callbacks)
+				callback.second(frame);
+			for (auto& pending : delivery_->promises)
+				pending.set_value(frame);
+			delivery_->promises.clear();
+		}
+
+		bool CCamReader::IsDeliveryRequested()
+		{
+			lock_guard<mutex> guard(delivery_->lock);
+			return !delivery_->callbacks.empty() || !delivery_->promises.empty();
+		}
+
+		const cv::Mat& CCamReader::ReturnFrame(const cv::Mat& image, const FrameInfo& info, long long call_tick)
+		{
+			const unsigned long long last_seq = last_info_.seq;
+			img_buf_ = image;
+			last_info_ = info;
+			last_info_.is_new = !img_buf_.empty() && info.seq != last_seq;
+
+			delivery_->latency[STAGE_WAIT].RecordSince(call_tick);
+			if (last_info_.is_new)
+			{
+				++delivery_->frames_returned;
+				if (last_seq && info.seq > last_seq + 1)
+					delivery_->frames_skipped += info.seq - last_seq - 1;
+			}
+			return img_buf_;
+		}
+
+		void CCamReader::CountFrame(const FrameInfo& info)
+		{
+			++delivery_->frames_produced;
+			delivery_->newest_tick = info.capture_tick;
+			delivery_->latency[STAGE_DECODE].Record(info.decode_ms);
+		}
+
+		ReaderStats CCamReader::GetStats()
+		{
+			ReaderStats stats;
+			const double tick_frequency = getTickFrequency();
+			stats.elapsed_sec = (getTickCount() - delivery_->stats_start_tick) / tick_frequency;
+			for (int i = 0; i < STAGE_CNT; ++i)
+				stats.stages[i] = delivery_->latency[i].GetStats(stats.elapsed_sec);
+			stats.stages[STAGE_BALANCE] = g_balance_latency.GetStats((getTickCount() - g_balance_start_tick) / tick_frequency);
+			stats.frames_produced = delivery_->frames_produced;
+			stats.frames_returned = delivery_->frames_returned;
+			stats.frames_skipped = delivery_->frames_skipped;
+			stats.input_retries = delivery_->input_retries;
+			stats.decode_errors = delivery_->decode_errors;
+			stats.packets_dropped = delivery_->packets_dropped;
+			stats.frames_lost = delivery_->jitter.GetLost();
+			stats.jitter_ms = delivery_->jitter.GetJitterMs();
+			stats.reconnects = delivery_->reconnects;
+			const long long newest_tick = delivery_->newest_tick;
+			stats.frame_age_ms = newest_tick ? MsSince(newest_tick) : -1;
+			stats.stalls = delivery_->stalls;
+			stats.stalled_ms = (double)delivery_->stalled_ms;
+			stats.longest_stall_ms = (double)delivery_->longest_stall_ms;
+			const long long stall_start_tick = delivery_->stall_start_tick;
+			if (stall_start_tick)
+			{
+				const double stall_ms = MsSince(stall_start_tick);
+				stats.stalled_ms += stall_ms;
+				stats.longest_stall_ms = max(stats.longest_stall_ms, stall_ms);
+			}
+			stats.queue = delivery_->frame_ring.GetStats();
+			return stats;
+		}
+
+		void CCamReader::ResetStats()
+		{
+			for (int i = 0; i < STAGE_CNT; ++i)
+				delivery_->latency[i].Reset();
+			delivery_->ResetCounters();
+		}
+
+		void CCamReader::ConvertLastImage(int channels)
+		{
+			if (img_buf_.empty() || last_info_.format == PIXEL_PACKED && img_buf_.channels() == channels)
+				return;
+
+			const long long convert_tick = getTickCount();
+			Frame frame;
+			frame.image = img_buf_;
+			frame.info = last_info_;
+			// A gray-scale image of YUV planes is a view of the Y plane, and needs no buffer.
+			if (last_info_.format == PIXEL_PACKED || channels != 1)
+			{
+				const int rows = last_info_.format == PIXEL_PACKED ? img_buf_.rows : img_buf_.rows * 2 / 3;
+				img_buf_ = buffer_pool_.Acquire(rows, img_buf_.cols, CV_8UC(channels));
+			}
+			Convert(frame, img_buf_, channels);
+			last_info_.format = PIXEL_PACKED;
+			last_info_.convert_ms = MsSince(convert_tick);
+			delivery_->latency[STAGE_CONVERT].Record(last_info_.convert_ms);
+		}
+
+		bool CCamReader::GetYuvImage(YuvPlanes& planes, PixelFormat format)
+		{
+			if (GetRawImage().empty())
+			{
+				planes = YuvPlanes();
+				return false;
+			}
+
+			const long long convert_tick = getTickCount();
+			bool converted = false;
+			if (last_info_.format == PIXEL_PACKED)
+			{
+				Mat yuv = buffer_pool_.Acquire(img_buf_.rows * 3 / 2, img_buf_.cols, CV_8UC1);
+				if (img_buf_.channels() == 1)
+				{
+					Mat luma = yuv.rowRange(0, img_buf_.rows);
+					img_buf_.copyTo(luma);
+					yuv.rowRange(img_buf_.rows, yuv.rows).setTo(Scalar(128));
+				}
+				else
+					cv::cvtColor(img_buf_, yuv, img_buf_.channels() == 3 ? CV_BGR2YUV_YV12 : CV_BGRA2YUV_YV12);
+				img_buf_ = yuv;
+				last_info_.format = PIXEL_YV12;
+				converted = true;
+			}
+
+			Frame frame;
+			frame.image = img_buf_;
+			frame.info = last_info_;
+			GetPlanes(frame, planes);
+
+			if (format == PIXEL_NV12 && planes.format != PIXEL_NV12)
+			{
+				Mat interleaved = buffer_pool_.Acquire(planes.u.rows, planes.u.cols, CV_8UC2);
+				const Mat chroma[] = { planes.u, planes.v };
+				cv::merge(chroma, 2, interleaved);
+				planes.u = interleaved;
+				planes.v.release();
+				planes.format = PIXEL_NV12;
+				converted = true;
+			}
+
+			if (converted)
+			{
+				last_info_.convert_ms = MsSince(convert_tick);
+				delivery_->latency[STAGE_CONVERT].Record(last_info_.convert_ms);
+			}
+			return true;
+		}
+
+		/*! Find the regions of a source and of a resized output mapped onto each other.
+		 *	@param[in]	src		The size of the source.
+		 *	@param[in]	dst		The size of the output.
+		 *	@param[in]	fit		How to fit the source into the output.
+		 *	@param[out]	src_roi	Receives the region of the source to resize.
+		 *	@param[out]	dst_roi	Receives the region of the output to resize into. The rest is left black.
+		 */
+		static void FitRegions(const Size& src, const Size& dst, FitMode fit, Rect& src_roi, Rect& dst_roi)
+		{
+			src_roi = Rect(0, 0, src.width, src.height);
+			dst_roi = Rect(0, 0, dst.width, dst.height);
+			const bool wider = dst.width * src.height > src.width * dst.height;	//dst.width / dst.height > src.width / src.height
+			if (fit == FIT_CROP)
+			{
+				if (wider)
+				{
+					const int cut = (src.height - dst.height * src.width / dst.width) >> 1;
+					src_roi = Rect(0, cut, src.width, src.height - cut * 2);
+				}
+				else
+				{
+					const int cut = (src.width - dst.width * src.height / dst.height) >> 1;
+					src_roi = Rect(cut, 0, src.width - cut * 2, src.height);
+				}
+			}
+			else if (fit == FIT_LETTERBOX)
+			{
+				if (wider)
+				{
+					const int inner = dst.height * src.width / src.height;
+					dst_roi = Rect((dst.width - inner) >> 1, 0, inner, dst.height);
+				}
+				else
+				{
+					const int inner = dst.width * src.height / src.width;
+					dst_roi = Rect(0, (dst.height - inner) >> 1, dst.width, inner);
+				}
+			}
+		}
+
 		cv::Mat CCamReader::GetImage(int width, int height, int channels, bool crop, bool flip, int flip_mode)
 		{
-			img_buf_ = GetImage();
+			return GetImage(width, height, channels, crop ? FIT_CROP : FIT_STRETCH, flip, flip_mode);
+		}
 
-			if (img_buf_.empty())
+		cv::Mat CCamReader::GetImage(int width, int height, int channels, FitMode fit, bool flip, int flip_mode)
+		{
+			if (GetRawImage().empty())
 				img_buf_ = cv::Mat(0, 0, CV_8UC3);
+			else if (last_info_.format != PIXEL_PACKED && width && height)
+			{
+				// Convert, crop, resize and flip in one pass, reading only the source pixels the output needs.
+				const long long resize_tick = getTickCount();
+				Frame frame;
+				frame.image = img_buf_;
+				frame.info = last_info_;
+				YuvPlanes planes;
+				GetPlanes(frame, planes);
+
+				Rect src_roi, dst_roi;
+				FitRegions(planes.y.size(), Size(width, height), fit, src_roi, dst_roi);
+				const bool flip_x = flip && flip_mode != 0, flip_y = flip && flip_mode <= 0;
+				// The borders of a letterbox are uneven by a pixel at most; flip them along with the image.
+				if (flip_x)
+					dst_roi.x = width - dst_roi.x - dst_roi.width;
+				if (flip_y)
+					dst_roi.y = height - dst_roi.y - dst_roi.height;
+
+				cv::Mat fitted = buffer_pool_.Acquire(height, width, CV_8UC(channels));
+				if (dst_roi.size() != fitted.size())
+					fitted.setTo(Scalar::all(0));
+				cv::Mat inner = fitted(dst_roi);
+				ResizeYuv(planes, src_roi, inner, flip_x, flip_y);
+
+				img_buf_ = fitted;
+				last_info_.format = PIXEL_PACKED;
+				last_info_.resize_ms = MsSince(resize_tick);
+				delivery_->latency[STAGE_RESIZE].Record(last_info_.resize_ms);
+			}
 			else
 			{
-				Convert(img_buf_, channels);
+				// Every stage writes into a pooled buffer of its output shape, so a steady stream does not allocate.
+				ConvertLastImage(channels);
+				cv::Mat img = img_buf_;
+
+				const long long resize_tick = getTickCount();
 
-				if (width || height && (width != default_img_width_ || height != default_img_height_))
+				const bool resize = width || height && (width != default_img_width_ || height != default_img_height_);
+				if (resize)
 				{
-					if (crop)
-					{
-						if (width * default_img_height_ > default_img_width_ * height)	//width / height > default_img_width_ / default_img_height_
-						{
-							const int cut = (default_img_height_ - height * default_img_width_ / width) >> 1;
-							cv::resize(img_buf_.rowRange(cut, default_img_height_ - cut), img_buf_, cv::Size(width, height));
-						}
-						else
-						{
-							const int cut = (default_img_width_ - width * default_img_height_ / height) >> 1;
-							cv::resize(img_buf_.colRange(cut, default_img_width_ - cut), img_buf_, cv::Size(width, height));
-						}
-					}
-					else
-						cv::resize(img_buf_, img_buf_, cv::Size(width, height));
+					Rect src_roi, dst_roi;
+					FitRegions(img.size(), Size(width, height), fit, src_roi, dst_roi);
+					cv::Mat resized = buffer_pool_.Acquire(height, width, img.type());
+					if (dst_roi.size() != resized.size())
+						resized.setTo(Scalar::all(0));
+					cv::Mat inner = resized(dst_roi);
+					cv::resize(img(src_roi), inner, dst_roi.size());
+					img = resized;
+					delivery_->latency[STAGE_RESIZE].RecordSince(resize_tick);
 				}
 
+				// Never flip in place: the frame may be shared with other readers.
 				if (flip)
-					cv::flip(img_buf_, img_buf_, flip_mode);
+				{
+					const long long flip_tick = getTickCount();
+					cv::Mat flipped = buffer_pool_.Acquire(img.rows, img.cols, img.type());
+					cv::flip(img, flipped, flip_mode);
+					img = flipped;
+					delivery_->latency[STAGE_FLIP].RecordSince(flip_tick);
+				}
+				if (resize || flip)
+					last_info_.resize_ms = MsSince(resize_tick);
+
+				img_buf_ = img;
 			}
 
 			return img_buf_;
@@ -224,47 +1168,145 @@ namespace Theia
 
 		const cv::Mat& CWebCamReader::GetImage()
 		{
+			return GetImageWithin(frame_timeout_ms_);
+		}
+
+		const cv::Mat& CWebCamReader::GetImageWithin(int timeout_ms)
+		{
+			GetRawImageWithin(timeout_ms);
+			if (last_info_.format != PIXEL_PACKED)
+				ConvertLastImage(4);
+			return img_buf_;
+		}
+
+		const cv::Mat& CWebCamReader::GetRawImageWithin(int timeout_ms)
+		{
+			const long long call_tick = getTickCount();
 #ifdef _NO_HKSDK
+			if (stream_->delivering)
+			{
+				Frame frame;
+				bool got_frame;
+				if (delivery_->frame_ring.GetCapacity())
+					got_frame = delivery_->frame_ring.Pop(frame, timeout_ms);
+				else
+					got_frame = stream_->hub.ReadNewer(stream_->last_seq, frame, &stream_->last_seq, timeout_ms);
+				if (!got_frame)
+					return ReturnFrame(Mat(), FrameInfo(), call_tick);
+				return ReturnFrame(frame.image, frame.info, call_tick);
+			}
+
+			unique_lock<mutex> guard(stream_->cap_lock);
+			if (stream_->delivering)
+			{
+				// The delivery thread took over while we were waiting.
+				guard.unlock();
+				return GetRawImageWithin(timeout_ms);
+			}
+			FrameInfo info;
+			bool got_frame;
 			int attempt_cnt = 0;
 			do
 			{
-				cap_ >> img_buf_;
+				got_frame = ReadFrame(cap_, img_buf_, info);
 				++attempt_cnt;
-			} while (img_buf_.empty() && attempt_cnt < 100);
-			return img_buf_;
+			} while (!got_frame && attempt_cnt < 100);
+			if (!got_frame)
+				return ReturnFrame(Mat(), FrameInfo(), call_tick);
+			info.seq = ++stream_->frame_seq;
+			CountFrame(info);
+			return ReturnFrame(img_buf_, info, call_tick);
 #else
-			while (!img_prepared_)
-				SLEEP_MS(5);
-			img_buf_ = cv::Mat(default_img_height_, default_img_width_, CV_8UC4, decode_buf_ + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER));
-			img_prepared_ = false;
-			return img_buf_;
+			if (delivery_->frame_ring.GetCapacity())
+			{
+				Frame frame;
+				if (!delivery_->frame_ring.Pop(frame, timeout_ms))
+					return ReturnFrame(Mat(), FrameInfo(), call_tick);
+				return ReturnFrame(frame.image, frame.info, call_tick);
+			}
+
+			unique_lock<mutex> guard(stream_->frame_lock);
+			auto ready = [this] { return stream_->frame_seq != stream_->consumed_seq; };
+			if (timeout_ms < 0)
+				stream_->frame_ready.wait(guard, ready);
+			else if (!stream_->frame_ready.wait_for(guard, chrono::milliseconds(timeout_ms), ready))
+			{
+				// The stream is down, and maybe being connected again: report the gap instead of hanging.
+				guard.unlock();
+				return ReturnFrame(Mat(), FrameInfo(), call_tick);
+			}
+			stream_->consumed_seq = stream_->frame_seq;
+			return ReturnFrame(stream_->latest_frame.image, stream_->latest_frame.info, call_tick);
 #endif
 		}
 
 		const cv::Mat& CCamCapReader::GetImage()
 		{
-			auto& cam = usb_cams_[usb_camera_device_];
+			return GetImageWithin(frame_timeout_ms_);
+		}
+
+		const cv::Mat& CCamCapReader::GetImageWithin(int timeout_ms)
+		{
+			const long long call_tick = getTickCount();
+			if (!AwaitWarmUp(timeout_ms))
+				return ReturnFrame(Mat(), FrameInfo(), call_tick);
+			CamCap& cam = *cam_;
+			if (cam.grabbing)
+			{
+				Frame frame;
+				bool got_frame;
+				if (delivery_->frame_ring.GetCapacity())
+					got_frame = delivery_->frame_ring.Pop(frame, timeout_ms);
+				else if (capture_mode_ == CAPTURE_BROADCAST)
+					got_frame = cam.hub.ReadNewer(last_seq_, frame, &last_seq_, timeout_ms);
+				else
+					got_frame = cam.hub.Read(frame);
+				if (!got_frame)
+					return ReturnFrame(Mat(), FrameInfo(), call_tick);
+				return ReturnFrame(frame.image, frame.info, call_tick);
+			}
+
 			while (!cam.lock.try_lock())
 				SLEEP_MS(1);
+			if (cam.grabbing)
+			{
+				// The background thread took over while we were waiting.
+				cam.lock.unlock();
+				return GetImageWithin(timeout_ms);
+			}
+			FrameInfo info;
+			bool got_frame;
 			int attempt_cnt = 0;
 			do
 			{
-				cam.cap >> img_buf_;
+				got_frame = ReadFrame(cam.cap, img_buf_, info);
 				++attempt_cnt;
-			} while (img_buf_.empty() && attempt_cnt < 100);
+			} while (!got_frame && attempt_cnt < 100);
+			if (got_frame)
+				info.seq = ++cam.frame_seq;
 			cam.lock.unlock();
-			return img_buf_;
+			if (!got_frame)
+				return ReturnFrame(Mat(), FrameInfo(), call_tick);
+			CountFrame(info);
+			return ReturnFrame(img_buf_, info, call_tick);
 		}
 
 #ifndef _NO_HKSDK
-		void CALLBACK g_ExceptionCallBack(DWORD dwType, LONG user_id_, LONG lHandle, void *pUser)
+		void CALLBACK g_ExceptionCallBack(DWORD dwType, LONG lUserID, LONG lHandle, void *pUser)
 		{
-			char tempbuf[256] = { 0 };
 			switch (dwType)
 			{
+			case EXCEPTION_PREVIEW:
 			case EXCEPTION_RECONNECT:
-				printf("----------reconnect--------%lld\n", time(NULL));
+			{
+				// This runs on a thread of the SDK: only hand the camera over to its reconnect thread.
+				// The exception is not tied to a preview being stopped, so only the lookup keeps Logout() from freeing the camera meanwhile.
+				const CSlotTable<CWebCamReader, MAX_CLIENTS>::CLookup client(g_clients, [lHandle](CWebCamReader* client) { return client->stream_->play_handle.load() == lHandle; });
+				CLogger::Log(LOG_WARNING, "Preview %lld dropped (exception 0x%llx), reconnecting.", lHandle, dwType);
+				if (client.Get())
+					client.Get()->ScheduleReconnect();
 				break;
+			}
 			default:
 				break;
 			}
@@ -277,7 +1319,7 @@ namespace Theia
 #define YCrCb_STEP 3
 
 #pragma warning(suppress: 6262)
-		void Balance(cv::Mat& img, bool for_global, bool for_face)
+		static void BalanceImage(cv::Mat& img, bool for_global, bool for_face)
 		{
 			if (img.type() == CV_8U)
 				cv::equalizeHist(img, img);
@@ -358,7 +1400,7 @@ namespace Theia
 
 					if (b_r == d_r || b_g == d_g || b_b == d_b)
 					{
-						fprintf(stderr, "Unable to balance!\n");
+						CLogger::Log(LOG_WARNING, "Unable to balance!");
 						return;
 					}
 
@@ -421,109 +1463,393 @@ namespace Theia
 					const float cr_ratio = SKIN_Cr * (pixel_num >> 2) / (float)cr_cnt;
 					const float cb_ratio = SKIN_Cb * (pixel_num >> 2) / (float)cb_cnt;
 
-					for (int y = 0; y < img.rows; ++y)
-					{
-						uchar* line = img.ptr(y);
-						for (int x = 0; x < img.cols; ++x)
-						{
-							line[1] = min(int(line[1] * cr_ratio), 255);
-							line[2] = min(int(line[2] * cb_ratio), 255);
-							line += step;
-						}
-					}
+					for (int y = 0; y < img.rows; ++y)
+					{
+						uchar* line = img.ptr(y);
+						for (int x = 0; x < img.cols; ++x)
+						{
+							line[1] = min(int(line[1] * cr_ratio), 255);
+							line[2] = min(int(line[2] * cb_ratio), 255);
+							line += step;
+						}
+					}
+
+					if (original_type == CV_8UC3)	//rgb
+						cv::cvtColor(img, img, CV_YCrCb2RGB);
+					//cv::cvtColor(img, img, CV_YCrCb2BGR);
+					else	//rgba
+					{
+						cv::cvtColor(img, img, CV_YCrCb2RGB);
+						cv::cvtColor(img, img, CV_RGB2RGBA);
+					}
+				}
+			}
+		}
+
+		void Balance(cv::Mat& img, bool for_global, bool for_face)
+		{
+			const long long tick = getTickCount();
+			BalanceImage(img, for_global, for_face);
+			g_balance_latency.RecordSince(tick);
+		}
+
+		long CWebCamReader::Login(_In_ const char* dev_ip, unsigned short port, _In_ const char* username, _In_ const char* passwd, StreamType stream_type)
+		{
+			if (online_)
+				Logout();
+#ifndef _NO_HKSDK
+			stream_->dev_ip = dev_ip;
+			stream_->dev_port = port;
+			stream_->username = username;
+			stream_->passwd = passwd;
+			stream_->stream_type = stream_type;
+
+			stream_->client_slot = g_clients.Add(this);
+			if (stream_->client_slot < 0)
+			{
+				CLogger::Log(LOG_ERROR, "Too many web cameras playing, at most %lld.", MAX_CLIENTS);
+				return (last_error_ = NET_DVR_MAX_NUM);
+			}
+
+			StartInput();
+			const long error = Connect();
+			if (error != NET_DVR_NOERROR)
+			{
+				StopInput();
+				g_clients.Remove(stream_->client_slot);
+				stream_->client_slot = -1;
+				return (last_error_ = error);
+			}
+
+			{
+				lock_guard<mutex> guard(stream_->reconnect_lock);
+				stream_->stop_reconnect = false;
+			}
+#else
+			stringstream rtsp_url_ss;
+			rtsp_url_ss << "rtsp://" << username << ":" << passwd << "@" << dev_ip << ":" << port << "/" << CODEC << "/ch1/" << (stream_type == STREAM_SUB ? "sub" : "main") << "/av_stream";
+			const string& rtsp_url = stream_->rtsp_url = rtsp_url_ss.str();
+			cout << "Connecting web camera " << dev_ip << ":" << port << " through RTSP protocol at " << rtsp_url << endl;
+			if (!OpenRtsp())
+				return -1;
+#endif
+			online_ = true;
+#ifdef _NO_HKSDK
+			if (IsDeliveryRequested())
+				StartDelivery();
+#endif
+
+			return (last_error_ = NET_DVR_NOERROR);
+		}
+
+		void Convert(const cv::Mat& src, cv::Mat& dst, int num_channels)
+		{
+			int code = -1;
+			if (num_channels == 1)
+			{
+				if (src.type() == CV_8UC3)
+					code = CV_RGB2GRAY;
+				else if (src.type() == CV_8UC4)
+					code = CV_RGBA2GRAY;
+			}
+			else if (num_channels == 3)
+			{
+				if (src.type() == CV_8U)
+					code = CV_GRAY2RGB;
+				else if (src.type() == CV_8UC4)
+					code = CV_RGBA2RGB;
+			}
+			else if (num_channels == 4)
+			{
+				if (src.type() == CV_8U)
+					code = CV_GRAY2RGBA;
+				else if (src.type() == CV_8UC3)
+					code = CV_RGB2RGBA;
+			}
+
+			if (code >= 0)
+				cv::cvtColor(src, dst, code);
+			else if (&dst != &src)
+				dst = src;
+		}
+
+		void Convert(const Frame& src, cv::Mat& dst, int num_channels)
+		{
+			if (src.info.format == PIXEL_PACKED)
+			{
+				Convert(src.image, dst, num_channels);
+				return;
+			}
+
+			switch (num_channels)
+			{
+			case 1:
+				// The Y plane is the gray-scale image already.
+				dst = src.image.rowRange(0, src.image.rows * 2 / 3);
+				break;
+			case 3:
+				cv::cvtColor(src.image, dst, src.info.format == PIXEL_YV12 ? CV_YUV2BGR_YV12 : src.info.format == PIXEL_I420 ? CV_YUV2BGR_I420 : CV_YUV2BGR_NV12);
+				break;
+			case 4:
+				cv::cvtColor(src.image, dst, src.info.format == PIXEL_YV12 ? CV_YUV2BGRA_YV12 : src.info.format == PIXEL_I420 ? CV_YUV2BGRA_I420 : CV_YUV2BGRA_NV12);
+				break;
+			}
+		}
+
+		bool GetPlanes(const Frame& frame, YuvPlanes& planes)
+		{
+			planes = YuvPlanes();
+			if (frame.info.format == PIXEL_PACKED || frame.image.empty())
+				return false;
+
+			const int height = frame.image.rows * 2 / 3;
+			const int chroma_rows = height / 2, chroma_cols = frame.image.cols / 2;
+			planes.y = frame.image.rowRange(0, height);
+			planes.format = frame.info.format;
+
+			// The chroma planes are packed at half the stride of the luma, so they are cut from a single-row view of the buffer.
+			const Mat chroma = frame.image.rowRange(height, frame.image.rows).reshape(1, 1);
+			const int plane_size = chroma_rows * chroma_cols;
+			if (frame.info.format == PIXEL_NV12)
+				planes.u = chroma.colRange(0, plane_size * 2).reshape(2, chroma_rows);
+			else
+			{
+				const Mat first = chroma.colRange(0, plane_size).reshape(1, chroma_rows);
+				const Mat second = chroma.colRange(plane_size, plane_size * 2).reshape(1, chroma_rows);
+				planes.u = frame.info.format == PIXEL_YV12 ? second : first;
+				planes.v = frame.info.format == PIXEL_YV12 ? first : second;
+			}
+			return true;
+		}
+
+		void Convert(cv::Mat& img, int num_channels)
+		{
+			Convert(img, img, num_channels);
+		}
+
+#ifndef _NO_HKSDK
+		int CWebCamReader::AcquireDecodeBuf(int rows, int cols, int type)
+		{
+			// Only this thread moves latest_buf, and consumers take nothing but the latest buffer,
+			// so a buffer referenced by nobody else stays unreferenced while we decode into it.
+			int idx = -1;
+			for (int i = 0; i < (int)stream_->decode_bufs.size(); ++i)
+			{
+				if (i == stream_->latest_buf)
+					continue;
+				if (idx < 0)
+					idx = i;
+				if (*stream_->decode_bufs[i].refcount == 1)
+				{
+					idx = i;
+					break;
+				}
+			}
+
+			Mat& buf = stream_->decode_bufs[idx];
+			// Consumers still hold every spare buffer; leave the old pixels to them and decode into fresh memory.
+			if (*buf.refcount > 1)
+				buf.release();
+			buf.create(rows, cols, type);
+			return idx;
+		}
+
+		void CWebCamReader::StartInput()
+		{
+			stream_->scheduler = CDecodeScheduler::Acquire();
+			stream_->decode_stream = stream_->scheduler->Add([this] { return InputPackets(); });
+		}
+
+		void CWebCamReader::StopInput()
+		{
+			if (!stream_->decode_stream)
+				return;
+			stream_->scheduler->Remove(stream_->decode_stream);
+			stream_->decode_stream.reset();
+			stream_->scheduler.reset();
+
+			CPacketQueue::Packet packet;
+			while (stream_->packets.Front(packet))
+				stream_->packets.Pop();
+		}
+
+		void CWebCamReader::PublishFrame(int buf_idx, Frame& frame, long width, long height)
+		{
+			{
+				lock_guard<mutex> guard(stream_->frame_lock);
+				stream_->latest_buf = buf_idx;
+				default_img_width_ = width;
+				default_img_height_ = height;
+				frame.info.seq = ++stream_->frame_seq;
+				stream_->latest_frame = frame;
+			}
+			stream_->frame_ready.notify_all();
+			DeliverFrame(frame);
+		}
+#endif
 
-					if (original_type == CV_8UC3)	//rgb
-						cv::cvtColor(img, img, CV_YCrCb2RGB);
-					//cv::cvtColor(img, img, CV_YCrCb2BGR);
-					else	//rgba
+		vector<long> CWebCamReader::LoginAll(const vector<CWebCamReader*>& readers, const vector<WebCamAddress>& addresses,
+			size_t max_parallel, int timeout_ms, const LoginCallback& on_login)
+		{
+			const size_t camera_cnt = min(readers.size(), addresses.size());
+			vector<long> errors(camera_cnt, -1);
+			atomic<size_t> next_idx(0);
+			mutex callback_lock;
+
+			auto login_next = [&]
+			{
+				for (size_t idx = next_idx++; idx < camera_cnt; idx = next_idx++)
+				{
+					const WebCamAddress& address = addresses[idx];
+					readers[idx]->SetConnectTimeout(timeout_ms);
+					errors[idx] = readers[idx]->Login(address.dev_ip.c_str(), address.port, address.username.c_str(), address.passwd.c_str(), address.stream_type);
+					if (on_login)
 					{
-						cv::cvtColor(img, img, CV_YCrCb2RGB);
-						cv::cvtColor(img, img, CV_RGB2RGBA);
+						lock_guard<mutex> guard(callback_lock);
+						on_login(idx, errors[idx]);
 					}
 				}
-			}
+			};
+
+			// The calling thread logs in too, so that a single camera needs no thread at all.
+			vector<thread> threads;
+			for (size_t i = 1; i < min(max(max_parallel, size_t(1)), camera_cnt); ++i)
+				threads.push_back(thread(login_next));
+			login_next();
+			for (auto& t : threads)
+				t.join();
+			return errors;
 		}
 
-		long CWebCamReader::Login(_In_ const char* dev_ip, unsigned short port, _In_ const char* username, _In_ const char* passwd)
+		void CWebCamReader::SetTransport(StreamTransport transport, _In_ const char* multicast_ip)
 		{
-			if (online_)
-				Logout();
+			transport_ = transport;
+			multicast_ip_ = multicast_ip ? multicast_ip : "";
+		}
+
 #ifndef _NO_HKSDK
+		//! Connect timeout of the SDK until NET_DVR_SetConnectTime() changes it, in milliseconds.
+		const int SDK_CONNECT_MS = 3000;
+		//! The connect timeout of the SDK, shared by the logins of all web cameras.
+		CSharedSetting<int> g_connect_time([](const int& timeout_ms) { NET_DVR_SetConnectTime(DWORD(timeout_ms), 1); });
+
+		long CWebCamReader::Connect()
+		{
 			//---------------------------------------
 			// ע豸
 			NET_DVR_DEVICEINFO_V30 struDeviceInfo;
-			user_id_ = NET_DVR_Login_V30(
-				const_cast<char*>(dev_ip),
-				port,
-				const_cast<char*>(username), 
-				const_cast<char*>(passwd),
-				&struDeviceInfo);
+			{
+				// The timeout is global to the SDK, so it must stay in place until this login is done.
+				CSharedSetting<int>::CUse connect_time(g_connect_time, connect_timeout_ms_ > 0 ? connect_timeout_ms_ : SDK_CONNECT_MS);
+				user_id_ = NET_DVR_Login_V30(
+					const_cast<char*>(stream_->dev_ip.c_str()),
+					stream_->dev_port,
+					const_cast<char*>(stream_->username.c_str()),
+					const_cast<char*>(stream_->passwd.c_str()),
+					&struDeviceInfo);
+			}
 			if (user_id_ < 0)
 			{
 				fprintf(stderr, "Login error %d: %s\n", NET_DVR_GetLastError(), NET_DVR_GetErrorMsg());
-				return (last_error_ = NET_DVR_GetLastError());
+				return NET_DVR_GetLastError();
 			}
-			g_client_list[user_id_] = this;
-
 			//---------------------------------------
 			//Ԥûص
 			NET_DVR_CLIENTINFO ClientInfo = { 0 };
 			ClientInfo.hPlayWnd = NULL;         //ҪSDKʱΪЧֵȡʱΪ
 			ClientInfo.lChannel = 1;       //Ԥͨ
-			//ClientInfo.lLinkMode = 1 << 31;       //λ(31)Ϊ0ʾΪ1ʾ030λʾӷʽ0TCPʽ1UDPʽ2ಥʽ3RTPʽ;
-			ClientInfo.lLinkMode = 0;       //λ(31)Ϊ0ʾΪ1ʾ030λʾӷʽ0TCPʽ1UDPʽ2ಥʽ3RTPʽ;
-			ClientInfo.sMultiCastIP = NULL;   //ಥַҪಥԤʱ
+			//λ(31)Ϊ0ʾΪ1ʾ030λʾӷʽ0TCPʽ1UDPʽ2ಥʽ3RTPʽ;
+			ClientInfo.lLinkMode = (stream_->stream_type == STREAM_SUB ? LONG(1u << 31) : 0) | transport_;
+			ClientInfo.sMultiCastIP = transport_ == TRANSPORT_MULTICAST && !multicast_ip_.empty() ? const_cast<char*>(multicast_ip_.c_str()) : NULL;   //ಥַҪಥԤʱ
 
 			real_play_handle_ = NET_DVR_RealPlay_V30(user_id_, &ClientInfo, NULL, NULL, TRUE);
 
 			if (real_play_handle_ < 0)
 			{
 				printf("NET_DVR_RealPlay_V30 error\n");
-				NET_DVR_Logout(user_id_);
-				return (last_error_ = NET_DVR_GetLastError());
+				const long error = NET_DVR_GetLastError();
+				Disconnect();
+				return error;
 			}
+			stream_->play_handle = real_play_handle_;
 
-			if (!NET_DVR_SetRealDataCallBack(real_play_handle_, g_RealDataCallBack_V30, user_id_))
+			if (!NET_DVR_SetRealDataCallBack(real_play_handle_, g_RealDataCallBack_V30, DWORD(stream_->client_slot)))
 			{
 				printf("NET_DVR_SetRealDataCallBack error\n");
-				return (last_error_ = NET_DVR_GetLastError());
+				const long error = NET_DVR_GetLastError();
+				Disconnect();
+				return error;
 			}
-#else
-			stringstream rtsp_url_ss;
-			rtsp_url_ss << "rtsp://" << username << ":" << passwd << "@" << dev_ip << ":" << port << "/" << CODEC << "/ch1/main/av_stream";
-			string rtsp_url = rtsp_url_ss.str();
-			cout << "Connecting web camera " << dev_ip << ":" << port << " through RTSP protocol at " << rtsp_url << endl;
-			if (!cap_.open(rtsp_url))
-				return -1;
-#endif
-			online_ = true;
+			return NET_DVR_NOERROR;
+		}
 
-			return (last_error_ = NET_DVR_NOERROR);
+		void CWebCamReader::Disconnect()
+		{
+			stream_->play_handle = -1;
+			//رԤ
+			if (real_play_handle_ >= 0)
+				NET_DVR_StopRealPlay(real_play_handle_);
+			real_play_handle_ = -1;
+			//עû
+			if (user_id_ >= 0)
+				NET_DVR_Logout_V30(user_id_);
+			user_id_ = -1;
 		}
 
-		inline void Convert(cv::Mat& img, int num_channels)
+		void CWebCamReader::ScheduleReconnect()
 		{
-			if (num_channels == 1)
-			{
-				if (img.type() == CV_8UC3)
-					cv::cvtColor(img, img, CV_RGB2GRAY);
-				else if (img.type() == CV_8UC4)
-					cv::cvtColor(img, img, CV_RGBA2GRAY);
-			}
-			else if (num_channels == 3)
+			lock_guard<mutex> guard(stream_->reconnect_lock);
+			if (stream_->stop_reconnect || stream_->reconnecting)
+				return;
+			// A previous reconnect thread has finished, as it cleared reconnecting.
+			if (stream_->reconnect_thread.joinable())
+				stream_->reconnect_thread.join();
+			stream_->reconnecting = true;
+			stream_->reconnect_thread = thread([this] { Reconnect(); });
+		}
+
+		void CWebCamReader::Reconnect()
+		{
+			Disconnect();
+			for (int attempt = 0;; ++attempt)
 			{
-				if (img.type() == CV_8U)
-					cv::cvtColor(img, img, CV_GRAY2RGB);
-				else if (img.type() == CV_8UC4)
-					cv::cvtColor(img, img, CV_RGBA2RGB);
+				{
+					unique_lock<mutex> guard(stream_->reconnect_lock);
+					if (stream_->reconnect_stop.wait_for(guard, chrono::milliseconds(ReconnectDelayMs(attempt)), [this] { return stream_->stop_reconnect; }))
+						break;
+				}
+				if (Connect() == NET_DVR_NOERROR)
+				{
+					++delivery_->reconnects;
+					CLogger::Log(LOG_INFO, "Web camera reconnected after %lld attempts.", attempt + 1);
+					break;
+				}
 			}
-			else if (num_channels == 4)
+
+			lock_guard<mutex> guard(stream_->reconnect_lock);
+			stream_->reconnecting = false;
+		}
+
+		void CWebCamReader::StopReconnect()
+		{
 			{
-				if (img.type() == CV_8U)
-					cv::cvtColor(img, img, CV_GRAY2RGBA);
-				else if (img.type() == CV_8UC3)
-					cv::cvtColor(img, img, CV_RGB2RGBA);
+				lock_guard<mutex> guard(stream_->reconnect_lock);
+				stream_->stop_reconnect = true;
 			}
+			stream_->reconnect_stop.notify_all();
+			if (stream_->reconnect_thread.joinable())
+				stream_->reconnect_thread.join();
+		}
+#endif
+
+		void CWebCamReader::Recover()
+		{
+#ifdef _NO_HKSDK
+			// The grabbing thread opens the stream again by itself, as long as it runs.
+			StartDelivery();
+#else
+			ScheduleReconnect();
+#endif
 		}
 
 		const char* CWebCamReader::GetLastError()
@@ -538,28 +1864,127 @@ namespace Theia
 		void CWebCamReader::Logout()
 		{
 #ifndef _NO_HKSDK
+			StopReconnect();
+			Disconnect();
+			// No packet comes in once the preview is stopped, so the player is not used any more either.
+			StopInput();
 			//---------------------------------------
 			PlayM4_Stop(port_);
 			PlayM4_CloseStream(port_);
 			PlayM4_FreePort(port_);
-			//رԤ
-			NET_DVR_StopRealPlay(real_play_handle_);
-			//עû
-			NET_DVR_Logout_V30(user_id_);
+			port_ = -1;
+			stream_->sys_header.clear();
+			// Waits for the callbacks still using the camera, such as the exception callback, which stopping the preview does not stop.
+			// ScheduleReconnect() from those returns at once, as reconnecting is stopped.
+			g_clients.Remove(stream_->client_slot);
+			stream_->client_slot = -1;
 #else
+			StopDelivery();
 			cap_.release();
 #endif
 			online_ = false;
 		}
 
-		CWebCamReader::CWebCamReader(int max_img_width, int max_img_height) : port_(-1), online_(false)
+#ifdef _NO_HKSDK
+		//! The options the FFmpeg backend of OpenCV reads from the environment when opening a capture, shared by all web cameras.
+		CSharedSetting<string> g_capture_options([](const string& options)
 		{
-#ifndef _NO_HKSDK
+#ifdef _WIN32
+			_putenv_s("OPENCV_FFMPEG_CAPTURE_OPTIONS", options.c_str());
+#else
+			setenv("OPENCV_FFMPEG_CAPTURE_OPTIONS", options.c_str(), 1);
+#endif
+		});
+
+		bool CWebCamReader::OpenRtsp()
+		{
+			static const char* const RTSP_TRANSPORTS[] = { "rtsp_transport;tcp", "rtsp_transport;udp", "rtsp_transport;udp_multicast", "rtsp_transport;udp" };
+			stringstream options_ss;
+			options_ss << RTSP_TRANSPORTS[transport_];
+			if (connect_timeout_ms_ > 0)
+				options_ss << "|stimeout;" << connect_timeout_ms_ * 1000LL;
+			// Another capture opening with other options would change them under this one.
+			CSharedSetting<string>::CUse options(g_capture_options, options_ss.str());
+			return cap_.open(stream_->rtsp_url);
+		}
+
+		void CWebCamReader::StartDelivery()
+		{
+			lock_guard<mutex> guard(stream_->cap_lock);
+			if (!online_ || stream_->delivering)
+				return;
+
+			stream_->delivering = true;
+			stream_->delivery_thread = thread([this]
+			{
+				long long last_frame_tick = getTickCount();
+				int attempt = 0;
+				while (stream_->delivering)
+				{
+					Frame& frame = stream_->hub.BeginWrite();
+					if (!ReadFrame(cap_, frame.image, frame.info))
+					{
+						if (MsSince(last_frame_tick) < RECONNECT_MIN_MS)
+						{
+							SLEEP_MS(1);
+							continue;
+						}
+
+						// The stream dropped: open it again after a backoff, which Logout() cuts short.
+						const long long retry_tick = getTickCount();
+						const int delay_ms = ReconnectDelayMs(attempt++);
+						while (stream_->delivering && MsSince(retry_tick) < delay_ms)
+							SLEEP_MS(10);
+						if (!stream_->delivering)
+							break;
+						cap_.release();
+						if (OpenRtsp())
+						{
+							++delivery_->reconnects;
+							CLogger::Log(LOG_INFO, "Web camera reconnected after %lld attempts.", attempt);
+							last_frame_tick = getTickCount();
+						}
+					}
+					else
+					{
+						last_frame_tick = frame.info.capture_tick;
+						attempt = 0;
+						frame.info.seq = ++stream_->frame_seq;
+						delivery_->jitter.Add(frame.info.capture_tick, cap_.get(CV_CAP_PROP_POS_MSEC), cap_.get(CV_CAP_PROP_FPS));
+						stream_->hub.Publish();
+					}
+				}
+			});
+		}
+
+		void CWebCamReader::StopDelivery()
+		{
+			if (!stream_->delivering)
+				return;
+			stream_->delivering = false;
+			stream_->hub.Close();
+			stream_->delivery_thread.join();
+			stream_->hub.Reset();
+			stream_->last_seq = 0;
+		}
+#endif
+
+		CWebCamReader::CWebCamReader(int max_img_width, int max_img_height, int decode_buf_cnt) : online_(false), transport_(TRANSPORT_TCP), connect_timeout_ms_(0), stream_(new StreamState)
+		{
+#ifdef _NO_HKSDK
+			stream_->hub.Subscribe([this](const Frame& frame) { DeliverFrame(frame); });
+#else
+			port_ = -1;
+			user_id_ = -1;
+			real_play_handle_ = -1;
+
 			if (g_client_cnt == 0)
 			{
 				//---------------------------------------
 				// ʼ
 				NET_DVR_Init();
+				// Dropped previews are connected again by the readers, with backoff and without reopening their players.
+				NET_DVR_SetReconnect(RECONNECT_MAX_MS, FALSE);
 			}
 
 			//---------------------------------------
@@ -568,114 +1993,468 @@ namespace Theia
 
 			default_img_width_ = max_img_width;
 			default_img_height_ = max_img_height;
-			decode_buf_size_ = default_img_width_ * default_img_height_ * sizeof(BYTE) * 4 + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-
-			decode_buf_ = (PBYTE)_aligned_malloc(decode_buf_size_, 32);
+			// One buffer for the newest frame, one being decoded into, and at least one held by the consumer.
+			stream_->decode_bufs.resize(max(decode_buf_cnt, 3));
+			for (auto& buf : stream_->decode_bufs)
+				buf.create(default_img_height_ * 3 / 2, default_img_width_, CV_8UC1);
 
 			++g_client_cnt;
 #endif
 		}
 
+		CDualStreamReader::CDualStreamReader(int max_img_width, int max_img_height, int decode_buf_cnt, int main_idle_ms) :
+			CWebCamReader(max_img_width, max_img_height, decode_buf_cnt), main_attached_(false), main_used_tick_(0), main_idle_ms_(main_idle_ms),
+			max_img_width_(max_img_width), max_img_height_(max_img_height), decode_buf_cnt_(decode_buf_cnt), dev_port_(0)
+		{
+		}
+
+		CDualStreamReader::~CDualStreamReader()
+		{
+			DetachMainStream();
+		}
+
+		long CDualStreamReader::Login(_In_ const char* dev_ip, unsigned short port, _In_ const char* username, _In_ const char* passwd, StreamType stream_type)
+		{
+			DetachMainStream();
+			dev_ip_ = dev_ip;
+			dev_port_ = port;
+			username_ = username;
+			passwd_ = passwd;
+			return CWebCamReader::Login(dev_ip, port, username, passwd, stream_type);
+		}
+
+		void CDualStreamReader::Logout()
+		{
+			DetachMainStream();
+			CWebCamReader::Logout();
+		}
+
+		long CDualStreamReader::AttachMainStream()
+		{
+			main_used_tick_ = getTickCount();
+			if (main_attached_)
+				return NET_DVR_NOERROR;
+			if (dev_ip_.empty())
+				return -1;
+
+			if (!main_)
+				main_.reset(new CWebCamReader(max_img_width_, max_img_height_, decode_buf_cnt_));
+			// The main stream has a multicast group of its own, configured on the camera.
+			main_->SetTransport(GetTransport());
+			const long error = main_->Login(dev_ip_.c_str(), dev_port_, username_.c_str(), passwd_.c_str(), STREAM_MAIN);
+			main_attached_ = error == NET_DVR_NOERROR;
+			return error;
+		}
+
+		void CDualStreamReader::DetachMainStream()
+		{
+			if (!main_attached_)
+				return;
+			main_->Logout();
+			main_attached_ = false;
+		}
+
+		cv::Mat CDualStreamReader::GetHighResImage(const cv::Rect& roi, int channels)
+		{
+			if (AttachMainStream() != NET_DVR_NOERROR)
+				return Mat();
+
+			YuvPlanes planes;
+			if (!main_->GetYuvImage(planes))
+				return Mat();
+			main_used_tick_ = getTickCount();
+
+			// Scale the region from the sub-stream to the main stream, which may differ in aspect ratio as well.
+			const Size main_size = planes.y.size();
+			Rect main_roi(Point(), main_size);
+			if (roi.area() > 0 && default_img_width_ > 0 && default_img_height_ > 0)
+			{
+				const double sx = double(main_size.width) / default_img_width_;
+				const double sy = double(main_size.height) / default_img_height_;
+				const int x0 = int(floor(roi.x * sx)), y0 = int(floor(roi.y * sy));
+				const int x1 = int(ceil((roi.x + roi.width) * sx)), y1 = int(ceil((roi.y + roi.height) * sy));
+				main_roi = Rect(Point(x0, y0), Point(x1, y1)) & main_roi;
+				if (main_roi.area() <= 0)
+					return Mat();
+			}
+
+			Mat image(main_roi.size(), CV_8UC(channels));
+			ResizeYuv(planes, main_roi, image, false, false);
+			return image;
+		}
+
+		const cv::Mat& CDualStreamReader::GetRawImageWithin(int timeout_ms)
+		{
+			if (main_attached_ && main_idle_ms_ > 0 && MsSince(main_used_tick_) > main_idle_ms_)
+				DetachMainStream();
+			return CWebCamReader::GetRawImageWithin(timeout_ms);
+		}
+
 		CCamCapReader::~CCamCapReader()
 		{
-			ReleaseCap(usb_cams_[usb_camera_device_]);
+			// Recover() must not reopen the device any more.
+			SetFreshnessSlo(0);
+			CamCap& cam = *cam_;
+
+			delivery_->frame_ring.Close();
+			cam.hub.Unsubscribe(subscription_);
+
+			ReleaseCap(cam);
+		}
+
+		CCamCapReader::CCamCapReader(int usb_camera_device, int max_img_width, int max_img_height, UsbCaptureMode capture_mode, bool async_warm_up) :
+			usb_camera_device_(usb_camera_device), cam_(&AcquireCap(usb_camera_device)), capture_mode_(capture_mode), last_seq_(0), warm_(false)
+		{
+			CamCap& cam = *cam_;
+			// Subscribe before the warm-up starts, so that the first frame of the device is delivered too.
+			subscription_ = cam.hub.Subscribe([this](const Frame& frame) { DeliverFrame(frame); });
+			StartWarmUp(cam, usb_camera_device, max_img_width, max_img_height);
+
+			// Until the device tells its own.
+			default_img_width_ = max_img_width;
+			default_img_height_ = max_img_height;
+
+			if (capture_mode_ != CAPTURE_ON_DEMAND)
+				StartGrabbing(cam);
+
+			if (async_warm_up)
+				return;
+			try
+			{
+				WaitWarmUp();
+			}
+			catch (...)
+			{
+				// The destructor does not run for a constructor which throws.
+				delivery_->frame_ring.Close();
+				cam.hub.Unsubscribe(subscription_);
+				ReleaseCap(cam);
+				throw;
+			}
+		}
+
+		UsbWarmUpState CCamCapReader::GetWarmUpState()
+		{
+			CamCap& cam = *cam_;
+			lock_guard<mutex> guard(cam.warm_lock);
+			return cam.warm_state;
 		}
 
-		CCamCapReader::CCamCapReader(int usb_camera_device, int max_img_width, int max_img_height) :
-			usb_camera_device_(usb_camera_device)
+		bool CCamCapReader::WaitWarmUp(int timeout_ms)
 		{
-			InitUSBCap(usb_camera_device, max_img_width, max_img_height);
+			if (AwaitWarmUp(timeout_ms))
+				return true;
+			switch (GetWarmUpState())
+			{
+			case WARM_UP_NOT_FOUND:
+				throw CCameraNotFoundException("Cannot find USB camera!");
+			case WARM_UP_NO_INPUT:
+				throw CCameraNoInputException("The USB camera's input is empty!");
+			default:
+				return false;
+			}
+		}
+
+		bool CCamCapReader::AwaitWarmUp(long timeout_ms)
+		{
+			if (warm_)
+				return true;
+
+			CamCap& cam = *cam_;
+			unique_lock<mutex> guard(cam.warm_lock);
+			auto done = [&cam] { return cam.warm_state != WARM_UP_PENDING; };
+			if (timeout_ms < 0)
+				cam.warmed.wait(guard, done);
+			else
+				cam.warmed.wait_for(guard, chrono::milliseconds(timeout_ms), done);
+			if (cam.warm_state != WARM_UP_READY)
+				return false;
+
+			default_img_width_ = cam.width;
+			default_img_height_ = cam.height;
+			warm_ = true;
+			return true;
+		}
+
+		void CCamCapReader::StartDelivery()
+		{
+			StartGrabbing(*cam_);
+		}
+
+		void CCamCapReader::Recover()
+		{
+			CamCap& cam = *cam_;
+			switch (GetWarmUpState())
+			{
+			case WARM_UP_PENDING:
+				// The warm-up has a deadline of its own.
+				break;
+			case WARM_UP_READY:
+				ReopenCap(cam, usb_camera_device_);
+				break;
+			default:
+				// The default frame size is still the maximum one.
+				StartWarmUp(cam, usb_camera_device_, default_img_width_, default_img_height_);
+				break;
+			}
+		}
+
+		bool CCamCapReader::LockCapture()
+		{
+			CamCap& cam = *cam_;
+			if (cam.grabbing)
+				return false;
+			cam.lock.lock();
+			if (cam.grabbing)
+			{
+				cam.lock.unlock();
+				return false;
+			}
+			return true;
+		}
+
+		bool CCamCapReader::Grab()
+		{
+			return cam_->cap.grab();
+		}
 
-			default_img_width_ = (int)usb_cams_[usb_camera_device_].cap.get(CV_CAP_PROP_FRAME_WIDTH);
-			default_img_height_ = (int)usb_cams_[usb_camera_device_].cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+		bool CCamCapReader::Retrieve(cv::Mat& frame)
+		{
+			return cam_->cap.retrieve(frame);
+		}
+
+		void CCamCapReader::UnlockCapture()
+		{
+			cam_->lock.unlock();
 		}
 
 		CWebCamReader::~CWebCamReader()
 		{
-#ifndef _NO_HKSDK
+			// Recover() must not touch the stream any more.
+			SetFreshnessSlo(0);
+			delivery_->frame_ring.Close();
+#ifdef _NO_HKSDK
+			StopDelivery();
+#else
+			// The SDK callbacks could otherwise still find the camera in g_clients.
+			if (stream_->client_slot >= 0)
+				Logout();
+			StopReconnect();
+			StopInput();
 			--g_client_cnt;
 
 			if (!g_client_cnt)
 				NET_DVR_Cleanup();
+#endif
+		}
+
+		//! Highest index probed per capture driver, as the devices of a driver are numbered from 0.
+		const int MAX_PROBE_IDX = 16;
+
+		/*!	@struct CaptureDriver
+		 *	@brief A capture driver of OpenCV, whose devices have codes from base on.
+		 */
+		struct CaptureDriver
+		{
+			int base;
+			const char* name;
+			//! Number of indices to probe.
+			int idx_cnt;
+		};
 
-			_aligned_free(decode_buf_);
+		/*! The capture drivers which may be compiled into OpenCV on this platform.
+		 *	The ones of vendor SDKs are probed on any platform, in case OpenCV was built with them.
+		 *	V4L2 devices are listed from /dev instead.
+		 */
+		const CaptureDriver g_capture_drivers[] =
+		{
+#ifdef _WIN32
+			{ CV_CAP_DSHOW, "DSHOW", MAX_PROBE_IDX },
+			{ CV_CAP_MSMF, "MSMF", MAX_PROBE_IDX },
+			// VFW opens the same camera again after 10.
+			{ CV_CAP_VFW, "VFW", 10 },
 #endif
+#ifdef __APPLE__
+			{ CV_CAP_AVFOUNDATION, "AVFOUNDATION", MAX_PROBE_IDX },
+			{ CV_CAP_QT, "QT", MAX_PROBE_IDX },
+#endif
+#ifdef __ANDROID__
+			{ CV_CAP_ANDROID, "ANDROID", MAX_PROBE_IDX },
+			{ CV_CAP_ANDROID_BACK, "ANDROID_BACK", 1 },
+			{ CV_CAP_ANDROID_FRONT, "ANDROID_FRONT", 1 },
+#endif
+			{ CV_CAP_MIL, "MIL", MAX_PROBE_IDX },
+			{ CV_CAP_FIREWARE, "FIREWIRE", MAX_PROBE_IDX },
+			{ CV_CAP_STEREO, "STEREO", MAX_PROBE_IDX },
+			{ CV_CAP_UNICAP, "UNICAP", MAX_PROBE_IDX },
+			{ CV_CAP_PVAPI, "PVAPI", MAX_PROBE_IDX },
+			{ CV_CAP_OPENNI, "OPENNI", MAX_PROBE_IDX },
+			{ CV_CAP_XIAPI, "XIAPI", MAX_PROBE_IDX },
+			{ CV_CAP_GIGANETIX, "GIGANETIX", MAX_PROBE_IDX },
+			{ CV_CAP_INTELPERC, "INTELPERC", MAX_PROBE_IDX }
+		};
+
+		//! Most devices probed at once, so that enumerating does not open every candidate together.
+		const int MAX_PROBE_THREADS = 4;
+
+		/*!	@struct CameraProbe
+		 *	@brief A candidate device, and what opening it found.
+		 */
+		struct CameraProbe
+		{
+			UsbCameraInfo info;
+			//! Whether the device was opened, as opposed to skipped for lack of time.
+			bool probed;
+			bool grabbed;
+
+			CameraProbe() : probed(false), grabbed(false) {}
+		};
+
+		//! Turn a CV_CAP_PROP_FOURCC value into its four characters, or an empty string if the driver does not tell.
+		string FourCCName(double fourcc)
+		{
+			const unsigned int code = (unsigned int)fourcc;
+			string name;
+			for (int i = 0; code && i < 4; ++i)
+			{
+				const char c = char((code >> (i * 8)) & 0xFF);
+				if (c > ' ')
+					name += c;
+			}
+			return name;
 		}
 
-		bool CCamCapReader::EnumerateCameras(vector<int> &cam_idx)
+		//! Open the device of a probe and grab a frame from it.
+		void RunProbe(CameraProbe& probe)
 		{
-			cam_idx.clear();
-			struct CapDriver{
-				int enumValue; string enumName; string comment;
-			};
-			// list of all CAP drivers (see highgui_c.h)  
-			vector<CapDriver> drivers;
-			drivers.push_back({ CV_CAP_MIL, "CV_CAP_MIL", "MIL proprietary drivers" });
-			drivers.push_back({ CV_CAP_VFW, "CV_CAP_VFW", "platform native" });
-			drivers.push_back({ CV_CAP_FIREWARE, "CV_CAP_FIREWARE", "IEEE 1394 drivers" });
-			drivers.push_back({ CV_CAP_STEREO, "CV_CAP_STEREO", "TYZX proprietary drivers" });
-			drivers.push_back({ CV_CAP_QT, "CV_CAP_QT", "QuickTime" });
-			drivers.push_back({ CV_CAP_UNICAP, "CV_CAP_UNICAP", "Unicap drivers" });
-			drivers.push_back({ CV_CAP_DSHOW, "CV_CAP_DSHOW", "DirectShow (via videoInput)" });
-			drivers.push_back({ CV_CAP_MSMF, "CV_CAP_MSMF", "Microsoft Media Foundation (via videoInput)" });
-			drivers.push_back({ CV_CAP_PVAPI, "CV_CAP_PVAPI", "PvAPI, Prosilica GigE SDK" });
-			drivers.push_back({ CV_CAP_OPENNI, "CV_CAP_OPENNI", "OpenNI (for Kinect)" });
-			drivers.push_back({ CV_CAP_OPENNI_ASUS, "CV_CAP_OPENNI_ASUS", "OpenNI (for Asus Xtion)" });
-			drivers.push_back({ CV_CAP_ANDROID, "CV_CAP_ANDROID", "Android" });
-			drivers.push_back({ CV_CAP_ANDROID_BACK, "CV_CAP_ANDROID_BACK", "Android back camera" }),
-			drivers.push_back({ CV_CAP_ANDROID_FRONT, "CV_CAP_ANDROID_FRONT", "Android front camera" }),
-			drivers.push_back({ CV_CAP_XIAPI, "CV_CAP_XIAPI", "XIMEA Camera API" });
-			drivers.push_back({ CV_CAP_AVFOUNDATION, "CV_CAP_AVFOUNDATION", "AVFoundation framework for iOS" });
-			drivers.push_back({ CV_CAP_GIGANETIX, "CV_CAP_GIGANETIX", "Smartek Giganetix GigEVisionSDK" });
-			drivers.push_back({ CV_CAP_INTELPERC, "CV_CAP_INTELPERC", "Theia Perceptual Computing SDK" });
-
-			std::string winName, driverName, driverComment;
-			int driverEnum;
+			VideoCapture cap(probe.info.device);
 			Mat frame;
-			bool found;
-			std::cout << "Searching for cameras IDs..." << endl << endl;
-			for (int drv = 0; drv < drivers.size(); drv++)
-			{
-				driverName = drivers[drv].enumName;
-				driverEnum = drivers[drv].enumValue;
-				driverComment = drivers[drv].comment;
-				std::cout << "Testing driver " << driverName << "...";
-				found = false;
-
-				int maxID = 100; //100 IDs between drivers  
-				if (driverEnum == CV_CAP_VFW)
-					maxID = 10; //VWF opens same camera after 10 ?!?  
-				else if (driverEnum == CV_CAP_ANDROID)
-					maxID = 98; //98 and 99 are front and back cam  
-				else if ((driverEnum == CV_CAP_ANDROID_FRONT) || (driverEnum == CV_CAP_ANDROID_BACK))
-					maxID = 1;
-
-				for (int idx = 0; idx <maxID; idx++)
-				{
-					VideoCapture cap(driverEnum + idx);  // open the camera  
-					if (cap.isOpened())                  // check if we succeeded  
+			const bool opened = cap.isOpened();
+			probe.grabbed = opened && cap.read(frame) && !frame.empty();
+			if (probe.grabbed)
+			{
+				probe.info.width = frame.cols;
+				probe.info.height = frame.rows;
+				probe.info.format = FourCCName(cap.get(CV_CAP_PROP_FOURCC));
+			}
+			probe.probed = true;
+		}
+
+		/*! Probe devices on up to MAX_PROBE_THREADS threads.
+		 *	The probes of a group run one after another, as the drivers of a platform reach the same camera at the same index,
+		 *	and opening it through several of them at once may fail or hang.
+		 *	Probes not started before the deadline are skipped. The ones under way are waited for, so that no thread outlives the call holding a device.
+		 *	@param[in,out]	groups		The probes, grouped by index.
+		 *	@param[in]		timeout_ms	How long to keep starting probes.
+		 */
+		void ProbeCameras(vector<vector<CameraProbe> >& groups, int timeout_ms)
+		{
+			const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+			atomic<size_t> next_group(0);
+			auto probe_groups = [&groups, &next_group, deadline]
+			{
+				for (size_t group = next_group++; group < groups.size(); group = next_group++)
+				{
+					for (auto& probe : groups[group])
 					{
-						found = true;
-						cap >> frame;
-						if (frame.empty())
-							std::cout << endl << driverName << "+" << idx << "\t opens: OK \t grabs: FAIL";
-						else
-						{
-							std::cout << endl << driverName << "+" << idx << "\t opens: OK \t grabs: OK";
-							cam_idx.push_back(driverEnum + idx);  // vector of all available cameras 
-						}
-						// display the frame  
-						// imshow(driverName + "+" + to_string(idx), frame); waitKey(1);  
+						if (chrono::steady_clock::now() >= deadline)
+							return;
+						RunProbe(probe);
 					}
-					cap.release();
 				}
-				if (!found) cout << "Nothing !" << endl;
-				cout << endl;
+			};
+			vector<thread> threads;
+			for (int i = 0; i < MAX_PROBE_THREADS && i < (int)groups.size(); ++i)
+				threads.push_back(thread(probe_groups));
+			for (auto& probe_thread : threads)
+				probe_thread.join();
+
+			long long skipped = 0;
+			for (auto& group : groups)
+				skipped += count_if(group.begin(), group.end(), [](const CameraProbe& probe) { return !probe.probed; });
+			if (skipped)
+				CLogger::Log(LOG_WARNING, "%lld camera candidates were not probed within the probe timeout.", skipped);
+		}
+
+		//! Guards the result of the last enumeration.
+		mutex g_usb_cameras_lock;
+		//! The result of the last enumeration, valid if g_usb_cameras_listed is set.
+		vector<UsbCameraInfo> g_usb_cameras;
+		bool g_usb_cameras_listed = false;
+
+		bool CCamCapReader::EnumerateCameras(vector<int> &cam_idx)
+		{
+			vector<UsbCameraInfo> cameras;
+			EnumerateCameras(cameras);
+			cam_idx.clear();
+			for (auto& camera : cameras)
+				cam_idx.push_back(camera.device);
+			return !cam_idx.empty();
+		}
+
+		bool CCamCapReader::EnumerateCameras(vector<UsbCameraInfo>& cameras, bool refresh, int probe_timeout_ms)
+		{
+			lock_guard<mutex> guard(g_usb_cameras_lock);
+			if (g_usb_cameras_listed && !refresh)
+			{
+				cameras = g_usb_cameras;
+				return !cameras.empty();
+			}
+
+			// Every index of each driver, as a device may be missing at any index, and every V4L2 device node.
+			// Drivers not compiled into OpenCV fail at once, so they cost a failed open per index and no wait.
+			vector<vector<CameraProbe> > groups;
+			auto add_candidate = [&groups](int idx, const UsbCameraInfo& candidate)
+			{
+				if ((int)groups.size() <= idx)
+					groups.resize(idx + 1);
+				groups[idx].push_back(CameraProbe());
+				groups[idx].back().info = candidate;
+			};
+			for (auto& driver : g_capture_drivers)
+			{
+				for (int idx = 0; idx < driver.idx_cnt; ++idx)
+				{
+					UsbCameraInfo candidate;
+					candidate.device = driver.base + idx;
+					candidate.driver = driver.name;
+					add_candidate(idx, candidate);
+				}
+			}
+#ifdef __linux__
+			if (DIR* dev = opendir("/dev"))
+			{
+				while (dirent* entry = readdir(dev))
+				{
+					int idx;
+					char tail;
+					if (sscanf(entry->d_name, "video%d%c", &idx, &tail) != 1 || idx < 0 || idx >= 100)
+						continue;
+					UsbCameraInfo candidate;
+					candidate.device = CV_CAP_V4L2 + idx;
+					candidate.driver = "V4L2";
+					candidate.path = string("/dev/") + entry->d_name;
+					add_candidate(idx, candidate);
+				}
+				closedir(dev);
+			}
+#endif
+			ProbeCameras(groups, probe_timeout_ms);
+
+			g_usb_cameras.clear();
+			for (auto& group : groups)
+			{
+				for (auto& probe : group)
+				{
+					if (probe.grabbed)
+						g_usb_cameras.push_back(probe.info);
+				}
 			}
-			cout << cam_idx.size() << " camera IDs has been found ";
-			cout << "Press a key..." << endl; cin.get();
+			sort(g_usb_cameras.begin(), g_usb_cameras.end(), [](const UsbCameraInfo& a, const UsbCameraInfo& b) { return a.device < b.device; });
+			g_usb_cameras_listed = true;
 
-			return (cam_idx.size()>0); // returns success  
+			cameras = g_usb_cameras;
+			return !cameras.empty();
 		}
 	}
 }
\ No newline at end of file
@@ -29,10 +29,23 @@
 #pragma once
 
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef _M_CEE
+#include <future>
+#endif
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <CameraReader/CameraReader/frame.hpp>
+#include <CameraReader/CameraReader/frame_ring_stats.hpp>
+#include <CameraReader/CameraReader/reader_stats.hpp>
+#include <CameraReader/CameraReader/mat_pool.hpp>
+
 /*!	@def CAMERAREADER_API
  *	@brief A macro for VC++ auto dll import-export configuration.
  *
@@ -105,6 +118,45 @@ namespace Theia
 {
 	namespace Camera
 	{
+		/*!	@enum FitMode
+		 *	@brief How an image is fitted into a size of another aspect ratio.
+		 */
+		enum FitMode
+		{
+			//! Resize the whole image to the size, distorting it.
+			FIT_STRETCH,
+			//! Cut the image evenly on two sides to the aspect ratio of the size, then resize it.
+			FIT_CROP,
+			//! Resize the whole image to fit within the size, and fill the rest evenly on two sides with black.
+			FIT_LETTERBOX
+		};
+
+		/*!	@enum StreamType
+		 *	@brief Which encoded stream of a web camera to play.
+		 */
+		enum StreamType
+		{
+			//! The main stream, at the full resolution of the camera.
+			STREAM_MAIN,
+			//! The sub-stream, which the camera encodes at a much lower resolution, e.g. 640x360, and is much cheaper to decode.
+			STREAM_SUB
+		};
+
+		/*!	@enum StreamTransport
+		 *	@brief How a web camera sends its stream, in the order of the link modes of the HikVision SDK.
+		 */
+		enum StreamTransport
+		{
+			//! TCP, which retransmits lost packets, but holds back every later packet meanwhile.
+			TRANSPORT_TCP,
+			//! UDP, which never waits for lost packets. The decoder skips them up to the next key frame.
+			TRANSPORT_UDP,
+			//! UDP to a multicast group, so that any number of processes or hosts share one stream from the camera.
+			TRANSPORT_MULTICAST,
+			//! RTP, as negotiated by RTSP.
+			TRANSPORT_RTP
+		};
+
 		/*!	@class CCamReader
 		 *	@brief Base class for camera helpers.
 		 *
@@ -114,6 +166,12 @@ namespace Theia
 		class CAMERAREADER_API CCamReader
 		{
 		public:
+			//! Callback receiving a frame on the delivery thread of a reader.
+			typedef std::function<void(const Frame&)> FrameCallback;
+
+			CCamReader();
+			virtual ~CCamReader();
+
 			/*! Get the width of the default frame.
 			 *	@return		The width of the default frame.
 			 */
@@ -144,28 +202,232 @@ namespace Theia
 				bool flip = false,
 				int flip_mode = 0);
 
+			/*! Get the next image with specified parameters.
+			 *	Frames decoded to YUV are converted, cropped, resized and flipped in a single pass,
+			 *	which reads only the source pixels the output needs. Its time is counted as STAGE_RESIZE.
+			 *	@param[in] width	Expected width of the next image.
+			 *	@param[in] height	Expected height of the next image.
+			 *	@param[in] channels	Expected channels of the next image.
+			 *	@param[in] fit		How to fit the image into the expected size when its width-height rate does not match.
+			 *	@param[in] flip		Whether to flip the image.
+			 *	@param[in] flipmode	A flag to specify how to flip the array.
+			 *						0 means flipping around the x-axis.
+			 *						Positive value (for example, 1) means flipping around y-axis.
+			 *						Negative value (for example, -1) means flipping around both axes.
+			 *	@return				The image newly retrieved.
+			 */
+			cv::Mat GetImage(
+				int width,
+				int height,
+				int channels,
+				FitMode fit,
+				bool flip = false,
+				int flip_mode = 0);
+
 			/*! Get the next image with default parameters.
-			 *	@return			The image newly retrieved.
+			 *	Readers waiting for frames give up after the frame timeout, 5 s unless SetFrameTimeout() changes it,
+			 *	so callers must expect an empty image while a stream is down.
+			 *	@return			The image newly retrieved, or an empty image if none came within the frame timeout.
 			 */
 			virtual const cv::Mat& GetImage() = 0;
 
+			/*! Get the next image as the planes of YUV 4:2:0, for consumers taking YUV directly.
+			 *	Frames decoded to YV12 by the HikVision SDK are exposed in place, without converting or copying their pixels.
+			 *	Other frames, e.g. BGR ones from OpenCV captures, are converted to YV12 once, which is counted as STAGE_CONVERT.
+			 *	The planes share the pixels like the result of GetImage(), which GetLastImg() returns afterwards.
+			 *	@param[out] planes	Receives views of the planes, or empty images if no image was retrieved.
+			 *	@param[in] format	PIXEL_YV12 or PIXEL_I420 for three planes, or PIXEL_NV12 for interleaved chroma,
+			 *						which is interleaved into a new buffer unless the frame has that layout already.
+			 *	@return				Whether an image was retrieved.
+			 */
+			bool GetYuvImage(_Out_ YuvPlanes& planes, PixelFormat format = PIXEL_I420);
+
+			/*! Get the next image with default parameters, provided it was captured recently enough.
+			 *	Older frames are skipped, so that a caller never acts on a picture of the past, e.g. after the stream stalled.
+			 *	@param[in] max_age_ms	How long ago the image may have been captured at most, in milliseconds.
+			 *	@param[in] timeout_ms	How long to wait for such an image at most, in milliseconds. -1 to wait for ever.
+			 *	@return					The image newly retrieved, or an empty image if none came in time.
+			 */
+			const cv::Mat& GetFreshImage(int max_age_ms, int timeout_ms);
+
+			/*! Set how long GetImage() waits for a new frame.
+			 *	While the stream is down and being recovered, GetImage() then returns empty images at this interval instead of hanging.
+			 *	Readers of USB cameras wait only in background grab mode, or with a frame queue.
+			 *	@param[in] timeout_ms	The timeout, 5000 by default. -1 to wait for ever.
+			 */
+			void SetFrameTimeout(int timeout_ms) { frame_timeout_ms_ = timeout_ms; }
+
+			/*! Watch the age of the newest frame, and recover the reader once it gets older than the given age.
+			 *	Frames then have to be produced without calls to GetImage(), so the reader starts its delivery thread like Subscribe().
+			 *	Each time the age exceeds the limit, a stall is counted and the reader recovers,
+			 *	e.g. a web camera connects again and a USB camera reopens its device.
+			 *	Recovery is repeated with a growing backoff until a frame comes. The stall counters are reported by GetStats().
+			 *	Derived readers stop watching in their destructors, before Recover() loses its state.
+			 *	@param[in] max_age_ms	The maximum age of the newest frame, in milliseconds. 0 to stop watching.
+			 */
+			void SetFreshnessSlo(int max_age_ms);
+
 			/*! Get the last image retrieved.
 			 *	Called only after calling GetImage.
 			 *	@return			The last image retrieved.
 			 */
 			cv::Mat GetLastImg() const { return img_buf_; }
 
+			/*! Get the metadata of the last image retrieved, including the time spent in each stage.
+			 *	Called only after calling GetImage.
+			 *	@return			The metadata of the last image retrieved.
+			 */
+			FrameInfo GetLastFrameInfo() const { return last_info_; }
+
+			/*! Queue every produced frame for GetImage() instead of keeping only the newest one.
+			 *	Only readers with a delivery thread of their own queue frames, i.e. CWebCamReader with the HikVision SDK,
+			 *	CCamCapReader in background grab mode, and any reader with a subscribed callback or a pending future.
+			 *	@param[in] capacity	Maximum number of queued frames. 0 restores the newest-frame behavior.
+			 *	@param[in] policy	What to do with a new frame when the queue is full.
+			 *						BLOCK_PRODUCER stalls the producer thread, which may be shared with other readers.
+			 */
+			void SetFrameQueue(size_t capacity, FrameDropPolicy policy = DROP_OLDEST);
+
+			/*! Get the counters of the frame queue, including the number of dropped frames.
+			 *	@return			A snapshot of the counters.
+			 */
+			FrameRingStats GetFrameQueueStats();
+
+			/*! Get the latency of each stage and the frame counters of the reader.
+			 *	The counters are always on, and cost a few atomic increments per frame.
+			 *	@return			A snapshot of the counters.
+			 */
+			ReaderStats GetStats();
+
+			/*! Restart all counters of the reader from zero.
+			 */
+			void ResetStats();
+
+			/*! Register a callback called with each new frame.
+			 *	The callback runs on the delivery thread of the reader, i.e. the decode callback of the HikVision SDK
+			 *	or the background grab thread of the device, which is started if needed. It should return quickly.
+			 *	The frame is passed without copying and must not be modified in place.
+			 *	Its pixels are in the format it was produced in, e.g. YV12 from the HikVision decoder, as told by info.format.
+			 *	Convert(const Frame&, cv::Mat&, int) turns them into packed pixels.
+			 *	Its pixels stay valid as long as a copy of its header is kept.
+			 *	The callback must not call Subscribe(), Unsubscribe() or GetImageAsync() itself.
+			 *	@param[in] callback	The callback.
+			 *	@return				An ID for Unsubscribe().
+			 */
+			int Subscribe(const FrameCallback& callback);
+
+			/*! Remove a callback registered by Subscribe().
+			 *	Once this returns, the callback is not running and will not be called again.
+			 *	@param[in] id		The ID returned by Subscribe().
+			 */
+			void Unsubscribe(int id);
+
+#ifndef _M_CEE
+			/*! Get the next frame without blocking the calling thread.
+			 *	The frame is shared like the ones passed to subscribed callbacks.
+			 *	Not available to code compiled with /clr, which cannot use std::future.
+			 *	@return				A future made ready with the next frame delivered by the reader.
+			 */
+			std::future<Frame> GetImageAsync();
+#endif
+
 		protected:
+			/*! Hand a new frame to the frame queue, the subscribed callbacks and the pending futures.
+			 *	Called on the delivery thread of the reader.
+			 *	@param[in] frame	The new frame.
+			 */
+			void DeliverFrame(const Frame& frame);
+
+			/*! Make sure a thread of the reader delivers frames to DeliverFrame().
+			 *	Called each time a callback or a future is registered.
+			 */
+			virtual void StartDelivery() {}
+
+			/*! Bring a stalled reader back to producing frames.
+			 *	Called on the thread of the stall watchdog, once the newest frame gets older than the limit of SetFreshnessSlo().
+			 */
+			virtual void Recover() {}
+
+			/*! Check whether any callback or future waits for frames.
+			 *	@return			True if DeliverFrame() has someone to deliver to, besides the frame queue.
+			 */
+			bool IsDeliveryRequested();
+
+			/*! Get the next image like GetImage(), but in the pixel format it was produced in.
+			 *	Readers producing frames that are not packed return them here, and convert them in GetImage().
+			 *	@return			img_buf_, described by last_info_.
+			 */
+			virtual const cv::Mat& GetRawImage() { return GetImage(); }
+
+			/*! Get the next image like GetImage(), but waiting for a new frame at most the given time instead of the frame timeout.
+			 *	Readers waiting for frames implement GetImage() with this, so that GetFreshImage() waits only as long as its caller has left.
+			 *	@param[in] timeout_ms	How long to wait, in milliseconds. -1 to wait for ever.
+			 *	@return					The image newly retrieved, or an empty image if none came in time.
+			 */
+			virtual const cv::Mat& GetImageWithin(int timeout_ms) { return GetImage(); }
+
+			/*! Convert img_buf_ into packed pixels of the given number of channels, unless it is already.
+			 *	The conversion writes into a buffer of buffer_pool_, and is counted as STAGE_CONVERT.
+			 *	@param[in] channels	The target channel number. 1: Gray-scale; 3: RGB; 4: RGBA.
+			 */
+			void ConvertLastImage(int channels);
+
+			/*! Make the given frame the result of GetImage().
+			 *	@param[in] image		The image of the frame, possibly img_buf_ itself.
+			 *	@param[in] info			The metadata of the frame.
+			 *	@param[in] call_tick	When GetImage() was called, in cv::getTickCount() ticks.
+			 *	@return					img_buf_.
+			 */
+			const cv::Mat& ReturnFrame(const cv::Mat& image, const FrameInfo& info, long long call_tick);
+
+			/*! Count a frame produced for the reader.
+			 *	Called by DeliverFrame(), and by readers for frames they read without delivering them.
+			 *	@param[in] info		The metadata of the frame.
+			 */
+			void CountFrame(const FrameInfo& info);
+
 			//! The width of the default frame.
 			long default_img_width_;
 			//! The height of the default frame.
 			long default_img_height_;
 
+			//! How long GetImage() waits for a new frame, in milliseconds. -1 for ever.
+			int frame_timeout_ms_;
+
 			//! The result image buffer.
 			cv::Mat img_buf_;
+			//! The metadata of the image in img_buf_.
+			FrameInfo last_info_;
+
+			//! Buffers for the conversion, resizing and flipping stages of GetImage(int, int, int, bool, bool, int).
+			CMatPool buffer_pool_;
+
+			/*! The frame queue, the callbacks and the pending futures, shared with the delivery thread.
+			 *	Defined in camera_reader.cpp, as this header is also compiled with /clr, which cannot include <mutex>.
+			 */
+			struct DeliveryState;
+			std::unique_ptr<DeliveryState> delivery_;
 
-			//! Whether the next image is prepared.
-			bool img_prepared_;
+		private:
+			//! Count a stall of the reader and recover it. Runs on the thread of the stall watchdog.
+			void CheckFreshness();
+		};
+
+		/*!	@struct WebCamAddress
+		 *	@brief Where and how to log in to a web camera, for CWebCamReader::LoginAll().
+		 */
+		struct WebCamAddress
+		{
+			std::string dev_ip;
+			unsigned short port;
+			std::string username;
+			std::string passwd;
+			//! Which stream of the camera to play, e.g. STREAM_SUB for a CDualStreamReader.
+			StreamType stream_type;
+
+			WebCamAddress() : port(8000), stream_type(STREAM_MAIN) {}
+			WebCamAddress(const std::string& dev_ip, unsigned short port, const std::string& username, const std::string& passwd, StreamType stream_type = STREAM_MAIN) :
+				dev_ip(dev_ip), port(port), username(username), passwd(passwd), stream_type(stream_type) {}
 		};
 
 		/*!	@class CWebCamReader
@@ -176,14 +438,40 @@ namespace Theia
 		class CAMERAREADER_API CWebCamReader : public CCamReader
 		{
 		public:
+			/*! Callback telling that a camera of LoginAll() is online, or failed to come online.
+			 *	Calls are serialized, but come from the threads logging in.
+			 *	@param[in] idx		The index of the camera in the arguments of LoginAll().
+			 *	@param[in] error	The result of Login(), 0 if the camera is online.
+			 */
+			typedef std::function<void(size_t idx, long error)> LoginCallback;
+
+			/*! Login to many web cameras at once, so that a slow or offline camera does not hold back the others.
+			 *	Cameras are logged in in the order given, by up to max_parallel threads at a time.
+			 *	Blocks until every camera is online or has failed.
+			 *	@param[in] readers		The readers to log in, e.g. fresh ones.
+			 *	@param[in] addresses	The address of the camera of each reader.
+			 *	@param[in] max_parallel	The maximum number of cameras being logged in at a time.
+			 *	@param[in] timeout_ms	How long to wait for each camera to answer. 0 for the default of the SDK or of FFmpeg.
+			 *	@param[in] on_login		Called as each camera comes online or fails, to report progress.
+			 *	@return					The result of Login() for each camera, 0 if it is online.
+			 */
+			static std::vector<long> LoginAll(
+				const std::vector<CWebCamReader*>& readers,
+				const std::vector<WebCamAddress>& addresses,
+				size_t max_parallel = 32,
+				int timeout_ms = 5000,
+				const LoginCallback& on_login = LoginCallback());
+
 			/*! Login to the web camera.
+			 *	@param[in] stream_type	Which stream of the camera to play.
 			 *	@return	The last error occurred (0 for no error).
 			 */
 			virtual long Login(
 				_In_ const char* dev_ip,
 				unsigned short port,
 				_In_ const char* username,
-				_In_ const char* passwd);
+				_In_ const char* passwd,
+				StreamType stream_type = STREAM_MAIN);
 			/*! Logout from the web camera.
 			 *	Remember to call this before deconstruction if logged in.
 			 */
@@ -193,8 +481,10 @@ namespace Theia
 			 *	Initializes basic environment with maximum image size parameters.
 			 *	@param[in] max_img_width		The min size of image to be retrieved from the camera.
 			 *	@param[in] max_img_height	The max size of image to be retrieved from the camera.
+			 *	@param[in] decode_buf_cnt	The number of decode buffers rotated between the decoder and consumers (at least 3).
+			 *								With a frame queue, use at least its capacity plus 2 to avoid allocating buffers on the fly.
 			 */
-			CWebCamReader(int max_img_width = 1980, int max_img_height = 1080);
+			CWebCamReader(int max_img_width = 1980, int max_img_height = 1080, int decode_buf_cnt = 3);
 			/*! Deconstructor of CWebCamReader.
 			 *	Release basic environment.
 			 *	Remember to call Logout() before deconstruction if logged in.
@@ -202,7 +492,11 @@ namespace Theia
 			virtual ~CWebCamReader();
 			
 			/*! Get the next image with default parameters.
-			 *	@return	The image newly retrieved.
+			 *	Blocks until a frame newer than the last returned one has been decoded, or the frame timeout elapses.
+			 *	Frames decoded to YV12 are converted to BGRA here.
+			 *	The pixels are not copied from the decoder, and stay unchanged as long as the returned image
+			 *	or any copy of its header is alive, i.e. until the next call to GetImage() unless the caller keeps a copy.
+			 *	@return	The image newly retrieved, or an empty image if none came within the frame timeout.
 			 */
 			const cv::Mat& GetImage();
 
@@ -210,6 +504,51 @@ namespace Theia
 			 *	@return			A const pointer to a static string containing the error message.
 			 */
 			const char* GetLastError();
+
+			/*! Choose how the camera sends its stream, from the next call to Login() on.
+			 *	Compare the frames_lost and jitter_ms counters of GetStats() to choose the transport of a network.
+			 *	Without the HikVision SDK, the transport is passed to FFmpeg through OPENCV_FFMPEG_CAPTURE_OPTIONS,
+			 *	which only OpenCV 3.3 and later read, and the multicast group is negotiated by RTSP.
+			 *	@param[in] transport	The transport. TRANSPORT_TCP by default.
+			 *	@param[in] multicast_ip	The multicast group to join with TRANSPORT_MULTICAST, e.g. "239.0.0.1".
+			 *							NULL to use the group configured on the camera.
+			 */
+			void SetTransport(StreamTransport transport, _In_ const char* multicast_ip = NULL);
+
+			//! Get the transport used by the next call to Login().
+			StreamTransport GetTransport() const { return transport_; }
+
+			/*! Set how long Login() waits for the camera to answer.
+			 *	The HikVision SDK keeps a single timeout for the whole process, which each Login() sets to its own.
+			 *	Without it, the timeout is passed to FFmpeg through OPENCV_FFMPEG_CAPTURE_OPTIONS like the transport.
+			 *	@param[in] timeout_ms	The timeout. 0 for the default of the SDK or of FFmpeg.
+			 */
+			void SetConnectTimeout(int timeout_ms) { connect_timeout_ms_ = timeout_ms; }
+
+		protected:
+			/*! Get the next image as decoded, i.e. YV12 planes with the HikVision SDK unless the player cannot deliver them.
+			 *	@see	GetImage()
+			 */
+			const cv::Mat& GetRawImage() { return GetRawImageWithin(frame_timeout_ms_); }
+
+			//! Get the next image like GetImage(), waiting for it at most the given time.
+			const cv::Mat& GetImageWithin(int timeout_ms);
+
+			/*! Get the next image like GetRawImage(), waiting for it at most the given time.
+			 *	@see	GetImageWithin()
+			 */
+			virtual const cv::Mat& GetRawImageWithin(int timeout_ms);
+
+			//! Connect the stream again, or restart the grabbing thread of RTSP, which then opens the stream again itself.
+			void Recover();
+
+#ifdef _NO_HKSDK
+			/*! Start a thread grabbing from the RTSP capture, if logged in.
+			 *	GetImage() then reads the frames grabbed by that thread.
+			 */
+			void StartDelivery();
+#endif
+
 		private:
 			//! Whether this object is connecting an online camera.
 			bool online_;
@@ -218,11 +557,73 @@ namespace Theia
 
 			//! The code of the last error.
 			long last_error_;
-#ifndef _NO_HKSDK
-			//! The size of decode buffer.
-			size_t decode_buf_size_;
-			//! The decode buffer.
-			PBYTE decode_buf_;
+
+			//! How the camera sends its stream.
+			StreamTransport transport_;
+			//! The multicast group of TRANSPORT_MULTICAST, or empty for the one configured on the camera.
+			std::string multicast_ip_;
+			//! How long Login() waits for the camera to answer, in milliseconds. 0 for the default.
+			int connect_timeout_ms_;
+
+			/*! Frames of the stream, shared between GetImage() and the thread producing them.
+			 *	Defined in camera_reader.cpp, like CCamReader::DeliveryState.
+			 */
+			struct StreamState;
+			std::unique_ptr<StreamState> stream_;
+#ifdef _NO_HKSDK
+			//! Stop the delivery thread and give cap_ back to GetImage().
+			void StopDelivery();
+			//! Open cap_ at StreamState::rtsp_url with the transport and the connect timeout of this reader.
+			bool OpenRtsp();
+#else
+			/*! Pick a decode buffer for the next frame, and make sure it has the given shape.
+			 *	Called only from the decode callback.
+			 *	@return	The index of the buffer in StreamState::decode_bufs.
+			 */
+			int AcquireDecodeBuf(int rows, int cols, int type);
+
+			/*! Make a frame decoded into a decode buffer the newest one, and deliver it.
+			 *	Called only from the decode callback.
+			 *	@param[in]		buf_idx	The index of the buffer holding the frame.
+			 *	@param[in,out]	frame	The frame, which gets its sequence number here.
+			 *	@param[in]		width	The width of the frame.
+			 *	@param[in]		height	The height of the frame.
+			 */
+			void PublishFrame(int buf_idx, Frame& frame, long width, long height);
+
+			//! Have the shared decode workers feed the packets handed over by the stream callback to the player.
+			void StartInput();
+			//! Take the stream off the decode workers, and drop the packets they have not fed yet.
+			void StopInput();
+			/*! Feed a bounded batch of queued packets to the player.
+			 *	Called only from a decode worker.
+			 *	@return	Whether any packet was fed.
+			 */
+			bool InputPackets();
+			/*! Feed a packet of the stream to the player, opening the player on the system header.
+			 *	Called only from a decode worker.
+			 *	@param[in] type	The type of the packet, as given to the stream callback.
+			 *	@param[in] data	The packet.
+			 *	@param[in] size	The size of the packet.
+			 *	@return			False if the player is full and the packet should be fed again later.
+			 */
+			bool InputPacket(unsigned long type, const unsigned char* data, size_t size);
+
+			/*! Login to the device and start the preview, i.e. the network part of Login().
+			 *	The player, the decode buffers and the decode workers are set up separately, and survive reconnections.
+			 *	@return	The last error occurred (0 for no error).
+			 */
+			long Connect();
+			//! Stop the preview and logout from the device, keeping the player.
+			void Disconnect();
+			/*! Start connecting again in the background, unless already doing so or logged out.
+			 *	Called from the exception callback of the SDK when the stream drops.
+			 */
+			void ScheduleReconnect();
+			//! Connect again with exponential backoff, until connected or logged out. Runs on StreamState::reconnect_thread.
+			void Reconnect();
+			//! Stop connecting again and wait for the background thread to finish.
+			void StopReconnect();
 
 			//! Connected port.
 			long port_;
@@ -234,7 +635,14 @@ namespace Theia
 			//! Counts the number of clients.
 			static int g_client_cnt;
 
-			//! Call back function for decoding.
+			//! Call back function receiving the exceptions of the SDK, which connects dropped streams again.
+			friend void CALLBACK g_ExceptionCallBack(
+				unsigned long dwType,
+				long lUserID,
+				long lHandle,
+				void* pUser);
+
+			//! Call back function receiving the stream, which hands the packets over to the decode workers.
 			friend void CALLBACK g_RealDataCallBack_V30(
 				long lRealHandle,
 				unsigned long dwDataType,
@@ -244,6 +652,91 @@ namespace Theia
 #endif
 		};
 
+		/*!	@class CDualStreamReader
+		 *	@brief Helper for web cameras, reading the sub-stream for analysis and the main stream only on demand.
+		 *
+		 *	GetImage() and the rest of the CCamReader interface serve the sub-stream,
+		 *	so that detection does not decode full-resolution frames only to downscale them.
+		 *	The main stream is played only while full-resolution images or regions are requested through GetHighResImage(),
+		 *	and is stopped again once nobody has requested one for a while.
+		 */
+		class CAMERAREADER_API CDualStreamReader : public CWebCamReader
+		{
+		public:
+			/*! Constructor of CDualStreamReader.
+			 *	@param[in] max_img_width	The max width of images of the main stream.
+			 *	@param[in] max_img_height	The max height of images of the main stream.
+			 *	@param[in] decode_buf_cnt	The number of decode buffers of each stream (at least 3).
+			 *	@param[in] main_idle_ms		How long the main stream keeps playing after the last call to GetHighResImage().
+			 *								0 to keep it until DetachMainStream() or Logout().
+			 */
+			CDualStreamReader(int max_img_width = 1980, int max_img_height = 1080, int decode_buf_cnt = 3, int main_idle_ms = 10000);
+			/*! Deconstructor of CDualStreamReader.
+			 *	Remember to call Logout() before deconstruction if logged in.
+			 */
+			virtual ~CDualStreamReader();
+
+			/*! Login to the web camera, and play its sub-stream.
+			 *	@param[in] stream_type	The stream read by GetImage(), STREAM_SUB unless the camera has no sub-stream.
+			 *	@return	The last error occurred (0 for no error).
+			 */
+			long Login(
+				_In_ const char* dev_ip,
+				unsigned short port,
+				_In_ const char* username,
+				_In_ const char* passwd,
+				StreamType stream_type = STREAM_SUB);
+			/*! Logout from the web camera, stopping both streams.
+			 */
+			void Logout();
+
+			/*! Start playing the main stream ahead of GetHighResImage(),
+			 *	which otherwise waits for the first frame the main stream decodes, i.e. up to a whole group of pictures.
+			 *	@return	The last error occurred (0 for no error).
+			 */
+			long AttachMainStream();
+			/*! Stop playing the main stream until the next call to GetHighResImage() or AttachMainStream().
+			 */
+			void DetachMainStream();
+			/*! Check whether the main stream is playing.
+			 */
+			bool IsMainStreamAttached() const { return main_ && main_attached_; }
+
+			/*! Get the next frame of the main stream, or a region of it, at full resolution.
+			 *	Starts playing the main stream if needed, and waits for its next frame.
+			 *	The frame is converted for the region only, without converting the rest of the frame.
+			 *	Call this from the thread calling GetImage(), which stops the main stream once it idles.
+			 *	@param[in] roi		The region in pixels of the images returned by GetImage(), e.g. a detected object,
+			 *						scaled to the main stream. An empty one for the whole frame.
+			 *	@param[in] channels	Expected channels of the image. 1: Gray-scale; 3: RGB; 4: RGBA.
+			 *	@return				The image of the region in a new buffer, or an empty image if the main stream cannot be played.
+			 */
+			cv::Mat GetHighResImage(const cv::Rect& roi = cv::Rect(), int channels = 4);
+
+		protected:
+			//! Read the next frame of the sub-stream, and stop the main stream if it idles.
+			const cv::Mat& GetRawImageWithin(int timeout_ms);
+
+		private:
+			//! The reader of the main stream, created by the first call to AttachMainStream().
+			std::unique_ptr<CWebCamReader> main_;
+			//! Whether main_ is logged in.
+			bool main_attached_;
+			//! When GetHighResImage() was last called, in cv::getTickCount() ticks.
+			long long main_used_tick_;
+			//! How long the main stream keeps playing without requests, in milliseconds. 0 for ever.
+			int main_idle_ms_;
+
+			int max_img_width_;
+			int max_img_height_;
+			int decode_buf_cnt_;
+
+			std::string dev_ip_;
+			unsigned short dev_port_;
+			std::string username_;
+			std::string passwd_;
+		};
+
 		/*!	@class	CCameraNotFoundException
 		 *	@brief	Exception for cases that specified camera device is not found.
 		 *	This exception is raised when the specified camera device is not found.
@@ -280,6 +773,60 @@ namespace Theia
 			explicit CCameraNoInputException(_In_ const char* _Message) : std::runtime_error(_Message) {}
 		};
 
+		/*!	@enum UsbCaptureMode
+		 *	@brief How a CCamCapReader gets frames from its device.
+		 */
+		enum UsbCaptureMode
+		{
+			//! GetImage() grabs from the device itself. Readers of one device take turns, and split its frame rate.
+			CAPTURE_ON_DEMAND,
+			//! A background thread grabs the device continuously, and GetImage() returns the newest frame at once.
+			CAPTURE_LATEST,
+			/*! The background thread broadcasts each frame to all readers of the device,
+			 *	and GetImage() waits for a frame this reader has not seen yet.
+			 *	Every reader then sees the full frame rate, as long as it keeps up.
+			 */
+			CAPTURE_BROADCAST
+		};
+
+		/*!	@enum UsbWarmUpState
+		 *	@brief How far a USB camera got in opening and sending its first frame.
+		 */
+		enum UsbWarmUpState
+		{
+			//! The device is being opened, or has not sent a frame yet.
+			WARM_UP_PENDING,
+			//! The device has sent its first frame.
+			WARM_UP_READY,
+			//! The device cannot be opened.
+			WARM_UP_NOT_FOUND,
+			//! The device opened, but sent no frame before the warm-up deadline.
+			WARM_UP_NO_INPUT
+		};
+
+		/*!	@struct UsbCameraInfo
+		 *	@brief A camera device found by CCamCapReader::EnumerateCameras().
+		 */
+		struct UsbCameraInfo
+		{
+			//! The code of the device, to pass to CCamCapReader.
+			int device;
+			//! The capture driver of OpenCV serving the device, e.g. "V4L2" or "DSHOW".
+			std::string driver;
+			//! The device node, e.g. "/dev/video0", or empty if the driver has none.
+			std::string path;
+			//! The size of the frames the device sends when opened.
+			int width;
+			int height;
+			//! The FourCC code of the pixel format, e.g. "YUYV" or "MJPG", or empty if the driver does not tell.
+			std::string format;
+
+			UsbCameraInfo() : device(-1), width(0), height(0) {}
+		};
+
+		//! The capture of a USB device, shared by its readers. Defined in camera_reader.cpp.
+		struct CamCap;
+
 		/*!	@class CCamCapReader
 			 *	@brief Helper for USB cameras.
 			 *
@@ -294,26 +841,94 @@ namespace Theia
 			const cv::Mat& GetImage();
 
 			/*! Constructor of CCamCapReader.
-			 *	Opens a capture of the camera specified by the given camera code,
-			 *	and try to set the resolution of the camera according to the specified max image size.
+			 *	Opens a capture of the camera specified by the given camera code in the background, and returns at once,
+			 *	so that many cameras warm up in parallel. The first frame of the device is delivered like any other once it comes.
+			 *	Until then, GetImage() waits for it up to the frame timeout, and the default frame size is the maximum one.
+			 *	Call WaitWarmUp() to wait for the first frame, and learn whether the device failed.
+			 *	The reader tries to set the resolution of the camera according to the specified max image size.
 			 *	@param[in]	usb_camera_device			The code of camera to capture. Availble ones can be obtained from EnumerateCameras(std::vector<int> &).
 			 *	@param[in]	max_img_width				Maximum width of images to be captured.
 			 *	@param[in]	max_img_height				Maximum height of images to be captured.
-			 *	@throws		CCameraNotFoundException	If the specified camera device is not found.
+			 *	@param[in]	capture_mode				How to get frames from the device.
+			 *											Once a reader starts the background thread of a device, it keeps running until the device is closed,
+			 *											and CAPTURE_ON_DEMAND readers of the device get the newest frame like CAPTURE_LATEST ones.
+			 *											Frames from the background thread are shared between readers and must not be modified in place.
+			 *	@param[in]	async_warm_up				Whether to return before the device sends its first frame.
+			 *											If not set, the constructor calls WaitWarmUp() itself.
+			 *	@throws		CCameraNotFoundException	If the specified camera device is not found, only without async_warm_up.
+			 *	@throws		CCameraNoInputException		If the device sends no frame before the warm-up deadline, only without async_warm_up.
 			 */
-			CCamCapReader(int usb_camera_device = 0, int max_img_width = 1980, int max_img_height = 1080);
+			CCamCapReader(int usb_camera_device = 0, int max_img_width = 1980, int max_img_height = 1080, UsbCaptureMode capture_mode = CAPTURE_ON_DEMAND,
+				bool async_warm_up = true);
 			/*! Deconstructor of CCamCapReader.
 				Close the camera capture.
 				*/
 			virtual ~CCamCapReader();
 
 			/*! List the codes of all available camera devices in the param std::vector.
+			 *	@see EnumerateCameras(std::vector<UsbCameraInfo>&, bool, int)
 			 *	@param[in]	cam_idx		std::vector buffer for the camera codes.
 			 *	@return				Whether at least one available camera is found.
 			 */
 			static bool EnumerateCameras(_In_ std::vector<int> &cam_idx);
+
+			/*! List all camera devices which open and send a frame.
+			 *	On Linux, the V4L2 device nodes are listed directly. Besides, every index of each capture driver of the platform is probed,
+			 *	so that a device is found whichever indices are free before it.
+			 *	A few candidates are probed at once, and the drivers of one index one after another, so that a camera is never opened twice at a time.
+			 *	Candidates not probed within probe_timeout_ms are skipped. The call still waits for the probes under way,
+			 *	so it may take longer if a driver hangs in opening a device.
+			 *	The result is kept for later calls. Devices opened by readers at the time may fail to probe.
+			 *	@param[out]	cameras				Receives the devices, ordered by code.
+			 *	@param[in]	refresh				Whether to probe again instead of returning the result of the last call.
+			 *	@param[in]	probe_timeout_ms	How long to keep probing candidates.
+			 *	@return							Whether at least one available camera is found.
+			 */
+			static bool EnumerateCameras(_Out_ std::vector<UsbCameraInfo>& cameras, bool refresh = false, int probe_timeout_ms = 3000);
+
+			//! Get how far the device got in opening and sending its first frame.
+			UsbWarmUpState GetWarmUpState();
+
+			/*! Wait for the device to send its first frame.
+			 *	@param[in]	timeout_ms	How long to wait at most, or -1 to wait for ever.
+			 *	@return					False if the device is still warming up.
+			 *	@throws		CCameraNotFoundException	If the specified camera device is not found.
+			 *	@throws		CCameraNoInputException		If the device sent no frame before the warm-up deadline.
+			 */
+			bool WaitWarmUp(int timeout_ms = -1);
 		private:
 			int usb_camera_device_;	//! Device ID of the USB camera.
+			CamCap* cam_;	//! The capture of the device, shared with the other readers of the device.
+			UsbCaptureMode capture_mode_;	//! How to get frames from the device.
+			unsigned long long last_seq_;	//! Sequence number of the last frame returned in broadcast mode.
+			int subscription_;	//! ID of the subscription feeding DeliverFrame().
+			bool warm_;	//! Whether the device has sent its first frame, and the default frame size is its own.
+
+			/*! Wait for the device to send its first frame, and take over its frame size.
+			 *	@return	False if the device is still warming up, or failed to.
+			 */
+			bool AwaitWarmUp(long timeout_ms);
+
+			/*! Take the device for grabbing through Grab() and Retrieve(), until UnlockCapture().
+			 *	@return	False if the background grab thread owns the device, in which case it is not taken.
+			 */
+			bool LockCapture();
+			//! Grab a frame from the device taken by LockCapture(), without decoding it.
+			bool Grab();
+			//! Decode the frame grabbed by Grab().
+			bool Retrieve(cv::Mat& frame);
+			//! Give back the device taken by LockCapture().
+			void UnlockCapture();
+
+			friend class CCameraGroup;
+
+		protected:
+			//! Get the next image like GetImage(), waiting for it at most the given time.
+			const cv::Mat& GetImageWithin(int timeout_ms);
+			//! Start the background grab thread of the device.
+			void StartDelivery();
+			//! Reopen the device and restart its background grab thread, for all readers of the device, or warm up a device which failed to.
+			void Recover();
 		};
 
 		/*! Convert the type of the image according to the param channels.
@@ -322,6 +937,29 @@ namespace Theia
 		 */
 		void CAMERAREADER_API Convert(_Inout_ cv::Mat& img, int num_channels);
 
+		/*! Convert the type of the image according to the param channels into another image.
+		 *	If dst already has the target size and type, its buffer is reused.
+		 *	@param	src				The image to be converted.
+		 *	@param	dst				The converted image. It refers to src if no conversion is needed.
+		 *	@param	num_channels	The target channel number. 1: Gray-scale; 3: RGB; 4: RGBA.
+		 */
+		void CAMERAREADER_API Convert(_In_ const cv::Mat& src, _Out_ cv::Mat& dst, int num_channels);
+
+		/*! Convert a frame into packed pixels of the given number of channels, according to the pixel format of the frame.
+		 *	A gray-scale image of YV12 planes refers to the Y plane of the frame without copying it.
+		 *	@param	src				The frame to be converted.
+		 *	@param	dst				The converted image. If it already has the target size and type, its buffer is reused.
+		 *	@param	num_channels	The target channel number. 1: Gray-scale; 3: RGB; 4: RGBA.
+		 */
+		void CAMERAREADER_API Convert(_In_ const Frame& src, _Out_ cv::Mat& dst, int num_channels);
+
+		/*! Get views of the planes of a YUV frame, without copying its pixels.
+		 *	@param	frame	The frame.
+		 *	@param	planes	Receives the planes, or empty images if the frame is not YUV.
+		 *	@return			Whether the frame is YUV.
+		 */
+		bool CAMERAREADER_API GetPlanes(_In_ const Frame& frame, _Out_ YuvPlanes& planes);
+
 		/*! Balance the hue and brightness of the image.
 		 *	@param	img			The image to be balanced.
 		 *	@param	for_global	If set as true, the image would be first balanced according to global color distribution.
@@ -341,13 +979,14 @@ namespace Theia
 				_In_ const char* dev_ip,
 				unsigned short port,
 				_In_ const char* username,
-				_In_ const char* passwd)
+				_In_ const char* passwd,
+				StreamType stream_type = STREAM_MAIN) override
 			{
 				return 0;
 			}
 			/*! Do nothing.
 			 */
-			inline void Logout() {}
+			inline void Logout() override {}
 
 			/*! Constructor of CFakeWebCamReader.
 			 */
@@ -361,7 +1000,17 @@ namespace Theia
 			/*! Get the next image (actually from the USB camera) with default parameters.
 			 *	@return	The image newly retrieved.
 			 */
-			inline const cv::Mat& GetImage() { return agent_.GetImage(); }
+			inline const cv::Mat& GetImage()
+			{
+				const long long call_tick = cv::getTickCount();
+				const cv::Mat& image = agent_.GetImage();
+				return ReturnFrame(image, agent_.GetLastFrameInfo(), call_tick);
+			}
+
+		protected:
+			//! The USB frames are packed already, and the agent waits for them with its own frame timeout.
+			inline const cv::Mat& GetRawImageWithin(int timeout_ms) override { return GetImage(); }
+
 		private:
 			CCamCapReader agent_;
 		};
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <CameraReader/CameraReader/decode_scheduler.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		//! How long an idle worker sleeps before checking its streams again, in case a wake-up was missed.
+		const milliseconds IDLE_WAIT(10);
+		//! How often the load of the workers is compared.
+		const milliseconds REBALANCE_PERIOD(1000);
+
+		//! The current time of steady_clock in nanoseconds, which fits an atomic.
+		static long long NowNs()
+		{
+			return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		}
+
+		struct CDecodeScheduler::Stream
+		{
+			Task task;
+			//! Held while the task runs, so that Remove() can wait for it.
+			mutex run_lock;
+			//! Set by Remove() under run_lock.
+			bool removed;
+			//! Index of the worker running the stream.
+			atomic<size_t> worker;
+			//! Nanoseconds spent in the task since the last rebalance.
+			atomic<long long> busy_ns;
+
+			Stream(const Task& task, size_t worker) : task(task), removed(false), worker(worker), busy_ns(0) {}
+		};
+
+		struct CDecodeScheduler::Worker
+		{
+			//! Guards streams, and orders wake-ups against the sleep of the worker.
+			mutex lock;
+			condition_variable wake;
+			//! Streams assigned to the worker.
+			vector<shared_ptr<Stream> > streams;
+			//! Bumped on each change of streams, so that the worker copies them only when they change.
+			atomic<unsigned> generation;
+			//! Set by Wake(), cleared by the worker before it runs its streams.
+			atomic<bool> signaled;
+			//! Set while the worker sleeps, so that Wake() skips the lock otherwise.
+			atomic<int> waiting;
+			thread runner;
+
+			Worker() : generation(0), signaled(false), waiting(0) {}
+		};
+
+		shared_ptr<CDecodeScheduler> CDecodeScheduler::Acquire()
+		{
+			static mutex shared_lock;
+			static weak_ptr<CDecodeScheduler> shared;
+
+			lock_guard<mutex> guard(shared_lock);
+			shared_ptr<CDecodeScheduler> scheduler = shared.lock();
+			if (!scheduler)
+			{
+				scheduler = make_shared<CDecodeScheduler>();
+				shared = scheduler;
+			}
+			return scheduler;
+		}
+
+		CDecodeScheduler::CDecodeScheduler(size_t worker_cnt) : last_rebalance_ns_(NowNs()), running_(true)
+		{
+			if (!worker_cnt)
+				worker_cnt = max(1u, thread::hardware_concurrency());
+			for (size_t i = 0; i < worker_cnt; ++i)
+				workers_.push_back(unique_ptr<Worker>(new Worker));
+			for (auto& worker : workers_)
+			{
+				Worker* w = worker.get();
+				w->runner = thread([this, w] { Run(*w); });
+			}
+		}
+
+		CDecodeScheduler::~CDecodeScheduler()
+		{
+			running_ = false;
+			for (auto& worker : workers_)
+			{
+				{
+					lock_guard<mutex> guard(worker->lock);
+				}
+				worker->wake.notify_one();
+				worker->runner.join();
+			}
+		}
+
+		shared_ptr<CDecodeScheduler::Stream> CDecodeScheduler::Add(const Task& task)
+		{
+			lock_guard<mutex> guard(assign_lock_);
+
+			// New streams have no load yet, so spread them by count.
+			size_t idx = 0;
+			for (size_t i = 1; i < workers_.size(); ++i)
+			{
+				if (workers_[i]->streams.size() < workers_[idx]->streams.size())
+					idx = i;
+			}
+
+			shared_ptr<Stream> stream = make_shared<Stream>(task, idx);
+			{
+				lock_guard<mutex> worker_guard(workers_[idx]->lock);
+				workers_[idx]->streams.push_back(stream);
+				++workers_[idx]->generation;
+			}
+			Wake(*stream);
+			return stream;
+		}
+
+		void CDecodeScheduler::Remove(const shared_ptr<Stream>& stream)
+		{
+			if (!stream)
+				return;
+			{
+				lock_guard<mutex> guard(assign_lock_);
+				Worker& worker = *workers_[stream->worker.load()];
+				lock_guard<mutex> worker_guard(worker.lock);
+				worker.streams.erase(remove(worker.streams.begin(), worker.streams.end(), stream), worker.streams.end());
+				++worker.generation;
+			}
+
+			// The worker may still run the stream from its old copy of the list, until it sees the flag.
+			lock_guard<mutex> guard(stream->run_lock);
+			stream->removed = true;
+		}
+
+		void CDecodeScheduler::Wake(const Stream& stream)
+		{
+			Worker& worker = *workers_[stream.worker.load()];
+			worker.signaled = true;
+			if (worker.waiting.load())
+			{
+				// Taking the lock orders the signal before the next check of the sleeping worker.
+				{
+					lock_guard<mutex> guard(worker.lock);
+				}
+				worker.wake.notify_one();
+			}
+		}
+
+		void CDecodeScheduler::Run(Worker& worker)
+		{
+			vector<shared_ptr<Stream> > streams;
+			unsigned generation = worker.generation.load() - 1;
+
+			while (running_)
+			{
+				worker.signaled = false;
+				if (worker.generation.load() != generation)
+				{
+					lock_guard<mutex> guard(worker.lock);
+					streams = worker.streams;
+					generation = worker.generation.load();
+				}
+
+				bool worked = false;
+				for (auto& stream : streams)
+				{
+					lock_guard<mutex> guard(stream->run_lock);
+					if (stream->removed)
+						continue;
+					const steady_clock::time_point start = steady_clock::now();
+					if (stream->task())
+					{
+						worked = true;
+						stream->busy_ns += duration_cast<nanoseconds>(steady_clock::now() - start).count();
+					}
+				}
+
+				if (NowNs() - last_rebalance_ns_.load() >= duration_cast<nanoseconds>(REBALANCE_PERIOD).count())
+					Rebalance();
+
+				if (!worked)
+				{
+					unique_lock<mutex> guard(worker.lock);
+					++worker.waiting;
+					worker.wake.wait_for(guard, IDLE_WAIT, [this, &worker] { return worker.signaled.load() || !running_; });
+					--worker.waiting;
+				}
+			}
+		}
+
+		void CDecodeScheduler::Rebalance()
+		{
+			unique_lock<mutex> guard(assign_lock_, try_to_lock);
+			if (!guard.owns_lock())
+				return;
+			const long long now_ns = NowNs();
+			const long long period_ns = now_ns - last_rebalance_ns_.load();
+			if (period_ns < duration_cast<nanoseconds>(REBALANCE_PERIOD).count())
+				return;
+			last_rebalance_ns_ = now_ns;
+
+			// Collect and restart the load of every stream.
+			vector<vector<pair<long long, shared_ptr<Stream> > > > loads(workers_.size());
+			vector<long long> totals(workers_.size(), 0);
+			for (size_t i = 0; i < workers_.size(); ++i)
+			{
+				lock_guard<mutex> worker_guard(workers_[i]->lock);
+				for (auto& stream : workers_[i]->streams)
+				{
+					const long long busy_ns = stream->busy_ns.exchange(0);
+					loads[i].push_back(make_pair(busy_ns, stream));
+					totals[i] += busy_ns;
+				}
+			}
+
+			const size_t hot = max_element(totals.begin(), totals.end()) - totals.begin();
+			const size_t cold = min_element(totals.begin(), totals.end()) - totals.begin();
+			if (hot == cold || totals[hot] * 2 < period_ns || loads[hot].size() < 2)
+				return;
+
+			// Move the stream that best evens out the two workers, if moving it helps at all.
+			const long long gap = totals[hot] - totals[cold];
+			shared_ptr<Stream> moved;
+			long long best_diff = 0;
+			for (auto& load : loads[hot])
+			{
+				if (load.first <= 0 || load.first >= gap)
+					continue;
+				const long long diff = llabs(gap - 2 * load.first);
+				if (!moved || diff < best_diff)
+				{
+					moved = load.second;
+					best_diff = diff;
+				}
+			}
+			if (!moved)
+				return;
+
+			{
+				lock_guard<mutex> worker_guard(workers_[hot]->lock);
+				vector<shared_ptr<Stream> >& streams = workers_[hot]->streams;
+				streams.erase(remove(streams.begin(), streams.end(), moved), streams.end());
+				++workers_[hot]->generation;
+			}
+			{
+				lock_guard<mutex> worker_guard(workers_[cold]->lock);
+				workers_[cold]->streams.push_back(moved);
+				++workers_[cold]->generation;
+				moved->worker = cold;
+			}
+			// The stream may have been woken on its old worker; make sure the new one looks at it.
+			Wake(*moved);
+		}
+	}
+}
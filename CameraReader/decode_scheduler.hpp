@@ -0,0 +1,106 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file decode_scheduler.hpp
+ *	@brief Fixed pool of threads feeding the decoders of many streams.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CDecodeScheduler
+		 *	@brief Runs the decoding work of many streams on about one thread per core.
+		 *
+		 *	Each stream sticks to one worker, so its decoder state stays in the caches of one core.
+		 *	A worker runs the streams assigned to it in turn, and sleeps when none of them has work.
+		 *	Workers measure the time each stream keeps them busy,
+		 *	and once a second a worker busy more than half the time hands a stream over to the least busy worker.
+		 *	All readers share one scheduler, which lives as long as any of them holds it.
+		 */
+		class CDecodeScheduler
+		{
+		public:
+			/*! Work of a stream, run by its worker until it returns false.
+			 *	It should do a bounded amount of work per call, so that the other streams of the worker get their turn.
+			 *	@return	Whether there was anything to do.
+			 */
+			typedef std::function<bool()> Task;
+
+			struct Stream;
+
+			/*! Get the shared scheduler, starting it if nobody holds it.
+			 *	@return	The scheduler, stopped once the last holder releases it.
+			 */
+			static std::shared_ptr<CDecodeScheduler> Acquire();
+
+			/*! Constructor of CDecodeScheduler.
+			 *	@param[in]	worker_cnt	The number of worker threads. 0 for one per core.
+			 */
+			explicit CDecodeScheduler(size_t worker_cnt = 0);
+			~CDecodeScheduler();
+
+			/*! Assign a stream to the least busy worker.
+			 *	@param[in]	task	The work of the stream.
+			 *	@return				A handle for Wake() and Remove().
+			 */
+			std::shared_ptr<Stream> Add(const Task& task);
+
+			/*! Remove a stream.
+			 *	Once this returns, its task is not running and will not be called again.
+			 */
+			void Remove(const std::shared_ptr<Stream>& stream);
+
+			/*! Tell the worker of a stream that the stream has work.
+			 *	Lock-free unless the worker is asleep, so it can be called for each packet from a network thread.
+			 */
+			void Wake(const Stream& stream);
+
+			//! Get the number of worker threads.
+			size_t GetWorkerCount() const { return workers_.size(); }
+
+		private:
+			struct Worker;
+
+			void Run(Worker& worker);
+			//! Hand a stream of the busiest worker over to the least busy one, if the busiest one runs hot.
+			void Rebalance();
+
+			std::vector<std::unique_ptr<Worker> > workers_;
+			//! Guards the assignment of streams to workers.
+			std::mutex assign_lock_;
+			//! When the streams were last rebalanced, in steady_clock nanoseconds. Read by every worker, written under assign_lock_.
+			std::atomic<long long> last_rebalance_ns_;
+			std::atomic<bool> running_;
+		};
+	}
+}
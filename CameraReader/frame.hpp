@@ -0,0 +1,111 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file frame.hpp
+ *	@brief Frames with the metadata of their capture.
+ */
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@enum PixelFormat
+		 *	@brief Layout of the pixels of a frame.
+		 */
+		enum PixelFormat
+		{
+			//! Packed gray-scale, BGR or BGRA pixels, as told by the number of channels of the image.
+			PIXEL_PACKED,
+			/*! Planar YV12 straight from the decoder, in a single-channel image of 3/2 times the frame height:
+			 *	the full Y plane, then the V and U planes at half the width and height.
+			 *	Convert(const Frame&, cv::Mat&, int) turns it into packed pixels.
+			 */
+			PIXEL_YV12,
+			//! Like PIXEL_YV12, but with the U plane before the V plane.
+			PIXEL_I420,
+			//! The full Y plane, then the U and V samples interleaved at half the width and height, in a single-channel image like PIXEL_YV12.
+			PIXEL_NV12
+		};
+
+		/*!	@struct YuvPlanes
+		 *	@brief The planes of a YUV 4:2:0 image, each as a view with its own stride.
+		 *
+		 *	The views share the pixels of the frame they come from, and keep them alive like any copy of its header.
+		 */
+		struct YuvPlanes
+		{
+			//! The Y plane, at the full width and height.
+			cv::Mat y;
+			//! The U plane at half the width and height, or with PIXEL_NV12, the interleaved U and V samples in a 2-channel image.
+			cv::Mat u;
+			//! The V plane at half the width and height, or empty with PIXEL_NV12.
+			cv::Mat v;
+			//! PIXEL_NV12 if the chroma is interleaved in u, else PIXEL_YV12 or PIXEL_I420, after the buffer the planes were cut from.
+			PixelFormat format;
+
+			YuvPlanes() : format(PIXEL_I420) {}
+		};
+
+		/*!	@struct FrameInfo
+		 *	@brief Where a frame comes from and what it cost to produce.
+		 */
+		struct FrameInfo
+		{
+			/*! When the frame was captured, in cv::getTickCount() ticks, which are monotonic.
+			 *	USB frames are stamped once grabbed from the device, web camera frames once decoded.
+			 */
+			long long capture_tick;
+			//! Frame number given by the decoder of the HikVision SDK, or -1 if the source has none.
+			long long source_frame_num;
+			/*! Sequence number of the frame in the stream of its reader, starting from 1.
+			 *	Readers of one USB device share the numbering of the device.
+			 */
+			unsigned long long seq;
+			//! False if the frame is the one already returned by the previous call to GetImage().
+			bool is_new;
+			//! Time spent decoding the frame into an image, in milliseconds.
+			double decode_ms;
+			//! Time spent converting the channels of the image in CCamReader::GetImage(int, int, int, bool, bool, int), in milliseconds.
+			double convert_ms;
+			/*! Time spent cropping, resizing and flipping the image in CCamReader::GetImage(int, int, int, bool, bool, int), in milliseconds.
+			 *	This includes converting frames decoded to YUV, which is done in the same pass.
+			 */
+			double resize_ms;
+			//! Layout of the pixels of the image.
+			PixelFormat format;
+
+			FrameInfo() : capture_tick(0), source_frame_num(-1), seq(0), is_new(false), decode_ms(0), convert_ms(0), resize_ms(0), format(PIXEL_PACKED) {}
+		};
+
+		/*!	@struct Frame
+		 *	@brief An image with its metadata.
+		 */
+		struct Frame
+		{
+			cv::Mat image;
+			FrameInfo info;
+		};
+	}
+}
@@ -0,0 +1,185 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file frame_hub.hpp
+ *	@brief Fan-out of the frames of one capture device to all its readers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <vector>
+
+#include <CameraReader/CameraReader/frame_mailbox.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CFrameHub
+		 *	@brief Broadcasts each frame grabbed from a device to every reader of the device.
+		 *
+		 *	The producer grabs once per sensor frame and publishes the result.
+		 *	Readers either fetch the newest frame, wait for one they have not seen yet, or get each frame pushed to a subscriber.
+		 *	All of them share the same reference-counted pixels, which the producer never writes again,
+		 *	so adding a reader costs nothing on the capture side.
+		 */
+		class CFrameHub
+		{
+		public:
+			//! Called on the producer thread with each published frame.
+			typedef std::function<void(const Frame&)> Subscriber;
+
+			CFrameHub() : waiters_(0), closed_(false), next_subscriber_id_(0) {}
+
+			/*! Get a buffer to grab the next frame into.
+			 *	@see CFrameMailbox::BeginWrite()
+			 */
+			Frame& BeginWrite() { return mailbox_.BeginWrite(); }
+
+			/*! Publish the buffer returned by BeginWrite() to all readers.
+			 *	Subscribers are called on the calling thread before this returns.
+			 */
+			void Publish()
+			{
+				const Frame& frame = mailbox_.BeginWrite();
+				mailbox_.Publish();
+
+				if (waiters_.load())
+				{
+					// Taking the lock orders the new sequence number before any waiter's next check.
+					{
+						std::lock_guard<std::mutex> guard(lock_);
+					}
+					new_frame_.notify_all();
+				}
+
+				std::lock_guard<std::mutex> guard(subscribers_lock_);
+				for (auto& subscriber : subscribers_)
+					subscriber.second(frame);
+			}
+
+			/*! Fetch the newest frame without waiting.
+			 *	@see CFrameMailbox::Read()
+			 */
+			bool Read(Frame& frame, unsigned long long* seq = NULL) { return mailbox_.Read(frame, seq); }
+
+			/*! Wait for a frame newer than the given one, then fetch the newest frame.
+			 *	@param[in]	last_seq	Sequence number of the last frame seen by the caller (0 for none).
+			 *	@param[out]	frame		Receives the newest frame.
+			 *	@param[out]	seq			If not NULL, receives the sequence number of the frame.
+			 *	@param[in]	timeout_ms	How long to wait at most, or -1 to wait for ever.
+			 *	@return					False if the hub was closed while waiting, or no newer frame came in time.
+			 */
+			bool ReadNewer(unsigned long long last_seq, Frame& frame, unsigned long long* seq = NULL, long timeout_ms = -1)
+			{
+				if (mailbox_.GetSequence() <= last_seq)
+				{
+					std::unique_lock<std::mutex> guard(lock_);
+					auto ready = [this, last_seq] { return mailbox_.GetSequence() > last_seq || closed_; };
+					++waiters_;
+					bool newer = true;
+					if (timeout_ms < 0)
+						new_frame_.wait(guard, ready);
+					else
+						newer = new_frame_.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready);
+					--waiters_;
+					if (closed_ || !newer)
+						return false;
+				}
+				return mailbox_.Read(frame, seq);
+			}
+
+			/*! Get the sequence number of the newest frame.
+			 *	@return	0 if nothing has been published yet.
+			 */
+			unsigned long long GetSequence() const { return mailbox_.GetSequence(); }
+
+			/*! Register a subscriber called with each published frame.
+			 *	The frame is shared with all readers and must not be modified in place.
+			 *	@return	An ID for Unsubscribe().
+			 */
+			int Subscribe(const Subscriber& subscriber)
+			{
+				std::lock_guard<std::mutex> guard(subscribers_lock_);
+				subscribers_.push_back(std::make_pair(++next_subscriber_id_, subscriber));
+				return next_subscriber_id_;
+			}
+
+			/*! Remove a subscriber.
+			 *	Once this returns, the subscriber is not running and will not be called again.
+			 */
+			void Unsubscribe(int id)
+			{
+				std::lock_guard<std::mutex> guard(subscribers_lock_);
+				for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it)
+				{
+					if (it->first == id)
+					{
+						subscribers_.erase(it);
+						break;
+					}
+				}
+			}
+
+			/*! Wake and fail all waiting readers until the hub is reset.
+			 */
+			void Close()
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock_);
+					closed_ = true;
+				}
+				new_frame_.notify_all();
+			}
+
+			/*! Drop all frames and reopen the hub.
+			 *	Must not be called while the producer is active. Subscribers are kept.
+			 *	Sequence numbers start from 1 again, so readers must forget the last one they saw.
+			 */
+			void Reset()
+			{
+				std::lock_guard<std::mutex> guard(lock_);
+				mailbox_.Reset();
+				closed_ = false;
+			}
+
+		private:
+			CFrameMailbox mailbox_;
+
+			//! Guards closed_ and orders new frames against waiting readers.
+			std::mutex lock_;
+			std::condition_variable new_frame_;
+			//! Number of readers waiting in ReadNewer(), so that Publish() skips the lock when nobody waits.
+			std::atomic<int> waiters_;
+			bool closed_;
+
+			std::mutex subscribers_lock_;
+			std::vector<std::pair<int, Subscriber> > subscribers_;
+			int next_subscriber_id_;
+		};
+	}
+}
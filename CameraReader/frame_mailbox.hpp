@@ -0,0 +1,162 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file frame_mailbox.hpp
+ *	@brief Lock-free latest-frame mailbox.
+ *
+ *	One producer thread publishes frames, and any number of readers fetch the newest one without blocking each other or the producer.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include <CameraReader/CameraReader/frame.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CFrameMailbox
+		 *	@brief Single-slot mailbox holding the newest frame of one producer.
+		 *
+		 *	The producer fills a slot that no reader can see, then publishes it with one atomic store.
+		 *	A reader pins the published slot only while copying the cv::Mat header, so neither side ever waits on the other.
+		 *	A pixel buffer is reused only when the mailbox holds its last reference, so frames handed out are never overwritten.
+		 */
+		class CFrameMailbox
+		{
+		public:
+			CFrameMailbox() : latest_(-1), seq_(0), writing_(-1)
+			{
+				for (int i = 0; i < SLOT_CNT; ++i)
+					slots_[i].readers = 0;
+			}
+
+			/*! Get a buffer to write the next frame into.
+			 *	Only the producer thread may call this.
+			 *	Calling it again before Publish() returns the same buffer.
+			 *	@return	A buffer invisible to readers until Publish() is called.
+			 */
+			Frame& BeginWrite()
+			{
+				if (writing_ < 0)
+				{
+					const int latest = latest_.load();
+					for (int i = 0; writing_ < 0; i = (i + 1) % SLOT_CNT)
+					{
+						if (i == latest || slots_[i].readers.load())
+						{
+							// All spare slots are pinned for a header copy, which is over in a few instructions.
+							if (i == SLOT_CNT - 1)
+								std::this_thread::yield();
+							continue;
+						}
+						writing_ = i;
+					}
+
+					// Someone still holds the old pixels; let the next write allocate fresh ones.
+					cv::Mat& image = slots_[writing_].frame.image;
+					if (image.refcount && *image.refcount > 1)
+						image.release();
+				}
+				return slots_[writing_].frame;
+			}
+
+			/*! Publish the buffer returned by BeginWrite() as the newest frame.
+			 *	Only the producer thread may call this.
+			 */
+			void Publish()
+			{
+				if (writing_ < 0)
+					return;
+				slots_[writing_].seq = seq_.load() + 1;
+				latest_.store(writing_);
+				seq_.store(slots_[writing_].seq);
+				writing_ = -1;
+			}
+
+			/*! Fetch the newest frame.
+			 *	The returned header shares pixels with the mailbox; they stay valid and unchanged while it is held.
+			 *	@param[out]	frame	Receives the newest frame.
+			 *	@param[out]	seq		If not NULL, receives the sequence number of the frame (starting from 1).
+			 *	@return				False if nothing has been published yet.
+			 */
+			bool Read(Frame& frame, unsigned long long* seq = NULL)
+			{
+				for (;;)
+				{
+					const int idx = latest_.load();
+					if (idx < 0)
+						return false;
+
+					++slots_[idx].readers;
+					if (latest_.load() == idx)
+					{
+						frame = slots_[idx].frame;
+						if (seq)
+							*seq = slots_[idx].seq;
+						--slots_[idx].readers;
+						return true;
+					}
+					--slots_[idx].readers;
+				}
+			}
+
+			/*! Get the sequence number of the newest frame.
+			 *	@return	0 if nothing has been published yet.
+			 */
+			unsigned long long GetSequence() const { return seq_.load(); }
+
+			/*! Drop all frames, and number the next one from 1 again.
+			 *	Must not be called while the producer or any reader is active.
+			 */
+			void Reset()
+			{
+				latest_ = -1;
+				seq_ = 0;
+				writing_ = -1;
+				for (int i = 0; i < SLOT_CNT; ++i)
+					slots_[i].frame.image.release();
+			}
+
+		private:
+			//! Number of slots: the published one, the one being written and spares for pinned readers.
+			enum { SLOT_CNT = 4 };
+
+			struct Slot
+			{
+				Frame frame;
+				unsigned long long seq;
+				std::atomic<int> readers;
+			};
+
+			Slot slots_[SLOT_CNT];
+			//! Index of the published slot, or -1 if empty.
+			std::atomic<int> latest_;
+			//! Sequence number of the published slot.
+			std::atomic<unsigned long long> seq_;
+			//! Index of the slot being written by the producer, or -1.
+			int writing_;
+		};
+	}
+}
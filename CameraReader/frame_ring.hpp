@@ -0,0 +1,203 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file frame_ring.hpp
+ *	@brief Bounded frame queue between one producer and one consumer.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include <CameraReader/CameraReader/frame_ring_stats.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CFrameRing
+		 *	@brief Bounded FIFO of frames between one producer thread and one consumer thread.
+		 *
+		 *	The capacity is fixed when the ring is (re)configured, so memory never grows with the backlog.
+		 *	Elements are only cv::Mat-like headers, so the lock is held for a few pointer swaps at a time.
+		 *	A ring with zero capacity is disabled and refuses every frame.
+		 */
+		template <typename T>
+		class CFrameRing
+		{
+		public:
+			CFrameRing() : head_(0), count_(0), policy_(DROP_OLDEST), closed_(false)
+			{
+				ResetCounters();
+			}
+
+			/*! Reconfigure the ring, discarding queued frames and reopening it if closed.
+			 *	@param[in]	capacity	Maximum number of queued frames. 0 disables the ring.
+			 *	@param[in]	policy		What to do with a new frame when the ring is full.
+			 */
+			void Reset(size_t capacity, FrameDropPolicy policy)
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock_);
+					slots_.assign(capacity, T());
+					head_ = 0;
+					count_ = 0;
+					policy_ = policy;
+					closed_ = false;
+					ResetCounters();
+				}
+				not_full_.notify_all();
+				not_empty_.notify_all();
+			}
+
+			/*! Offer a frame to the consumer.
+			 *	@param[in]	frame	The frame to queue.
+			 *	@return				Whether the frame was queued.
+			 */
+			bool Push(const T& frame)
+			{
+				std::unique_lock<std::mutex> guard(lock_);
+				if (slots_.empty() || closed_)
+					return false;
+
+				++pushed_;
+				if (count_ == slots_.size())
+				{
+					switch (policy_)
+					{
+					case DROP_NEWEST:
+						++dropped_newest_;
+						return false;
+					case BLOCK_PRODUCER:
+						++producer_waits_;
+						not_full_.wait(guard, [this] { return count_ < slots_.size() || closed_ || slots_.empty(); });
+						if (closed_ || slots_.empty())
+							return false;
+						break;
+					default:
+						slots_[head_] = T();
+						head_ = (head_ + 1) % slots_.size();
+						--count_;
+						++dropped_oldest_;
+						break;
+					}
+				}
+
+				slots_[(head_ + count_) % slots_.size()] = frame;
+				++count_;
+				guard.unlock();
+				not_empty_.notify_one();
+				return true;
+			}
+
+			/*! Take the oldest queued frame, waiting for one if the ring is empty.
+			 *	@param[out]	frame		Receives the frame.
+			 *	@param[in]	timeout_ms	How long to wait at most, or -1 to wait for ever.
+			 *	@return					False if the ring was closed or disabled while waiting, or the wait timed out.
+			 */
+			bool Pop(T& frame, long timeout_ms = -1)
+			{
+				std::unique_lock<std::mutex> guard(lock_);
+				auto ready = [this] { return count_ || closed_ || slots_.empty(); };
+				if (timeout_ms < 0)
+					not_empty_.wait(guard, ready);
+				else
+					not_empty_.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready);
+				if (!count_)
+					return false;
+
+				frame = slots_[head_];
+				// Do not pin the pixels in the ring once they are handed out.
+				slots_[head_] = T();
+				head_ = (head_ + 1) % slots_.size();
+				--count_;
+				++popped_;
+				guard.unlock();
+				not_full_.notify_one();
+				return true;
+			}
+
+			/*! Wake and fail every waiting Push() and Pop(), and refuse further frames until Reset().
+			 */
+			void Close()
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock_);
+					closed_ = true;
+				}
+				not_full_.notify_all();
+				not_empty_.notify_all();
+			}
+
+			/*! Get the capacity of the ring.
+			 *	@return	0 if the ring is disabled.
+			 */
+			size_t GetCapacity()
+			{
+				std::lock_guard<std::mutex> guard(lock_);
+				return slots_.size();
+			}
+
+			/*! Get a snapshot of the counters.
+			 */
+			FrameRingStats GetStats()
+			{
+				std::lock_guard<std::mutex> guard(lock_);
+				FrameRingStats stats;
+				stats.capacity = slots_.size();
+				stats.size = count_;
+				stats.pushed = pushed_;
+				stats.popped = popped_;
+				stats.dropped_oldest = dropped_oldest_;
+				stats.dropped_newest = dropped_newest_;
+				stats.producer_waits = producer_waits_;
+				return stats;
+			}
+
+		private:
+			void ResetCounters()
+			{
+				pushed_ = popped_ = dropped_oldest_ = dropped_newest_ = producer_waits_ = 0;
+			}
+
+			std::mutex lock_;
+			std::condition_variable not_empty_;
+			std::condition_variable not_full_;
+
+			std::vector<T> slots_;
+			//! Index of the oldest queued frame.
+			size_t head_;
+			//! Number of queued frames.
+			size_t count_;
+			FrameDropPolicy policy_;
+			bool closed_;
+
+			unsigned long long pushed_;
+			unsigned long long popped_;
+			unsigned long long dropped_oldest_;
+			unsigned long long dropped_newest_;
+			unsigned long long producer_waits_;
+		};
+	}
+}
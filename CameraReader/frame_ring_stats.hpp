@@ -0,0 +1,70 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file frame_ring_stats.hpp
+ *	@brief Configuration and counters of frame rings.
+ *
+ *	Kept apart from frame_ring.hpp, so that code compiled with /clr, which cannot include <mutex>, can use them.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@enum FrameDropPolicy
+		 *	@brief What a full frame ring does with a new frame.
+		 */
+		enum FrameDropPolicy
+		{
+			//! Discard the oldest queued frame to make room. Suits live analytics.
+			DROP_OLDEST,
+			//! Discard the new frame. Keeps the queued sequence contiguous.
+			DROP_NEWEST,
+			//! Wait until the consumer makes room. No frame is lost, but the producer is paced by the consumer.
+			BLOCK_PRODUCER
+		};
+
+		/*!	@struct FrameRingStats
+		 *	@brief Snapshot of the counters of a frame ring.
+		 */
+		struct FrameRingStats
+		{
+			//! Maximum number of queued frames (0 if the ring is disabled).
+			size_t capacity;
+			//! Number of frames currently queued.
+			size_t size;
+			//! Frames offered by the producer.
+			unsigned long long pushed;
+			//! Frames taken by the consumer.
+			unsigned long long popped;
+			//! Queued frames discarded under DROP_OLDEST.
+			unsigned long long dropped_oldest;
+			//! New frames discarded under DROP_NEWEST.
+			unsigned long long dropped_newest;
+			//! Times the producer had to wait under BLOCK_PRODUCER.
+			unsigned long long producer_waits;
+		};
+	}
+}
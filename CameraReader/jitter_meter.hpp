@@ -0,0 +1,119 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file jitter_meter.hpp
+ *	@brief Loss and jitter estimation of a live stream from the time stamps of its frames.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+
+#include <opencv2/core/core.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CJitterMeter
+		 *	@brief Estimates the frames lost by a stream and the jitter of their arrival, whatever the transport.
+		 *
+		 *	The jitter is the interarrival jitter of RFC 3550, computed per frame from the time stamps set by the camera:
+		 *	the smoothed difference between the time two consecutive frames arrived and the time the camera took them.
+		 *	A gap of more than one frame interval between consecutive time stamps counts the missing frames as lost.
+		 *	Only one thread adds frames, while any thread reads the estimates or resets the meter.
+		 */
+		class CJitterMeter
+		{
+		public:
+			CJitterMeter() : has_last_(false), last_arrival_ms_(0), last_stamp_ms_(0), jitter_ms_(0), restart_(false)
+			{
+				Reset();
+			}
+
+			/*! Count a frame as it arrives.
+			 *	@param[in] arrival_tick	When the frame arrived, in cv::getTickCount() ticks.
+			 *	@param[in] stamp_ms		The time stamp of the frame set by the camera, in milliseconds.
+			 *	@param[in] frame_rate	The nominal frame rate of the stream, or 0 if unknown, which disables loss counting.
+			 */
+			void Add(long long arrival_tick, double stamp_ms, double frame_rate)
+			{
+				// The state of the adding thread is only cleared here, so that Reset() may be called from any thread.
+				if (restart_.exchange(false, std::memory_order_acquire))
+				{
+					has_last_ = false;
+					jitter_ms_ = 0;
+				}
+
+				const double arrival_ms = arrival_tick * 1000. / cv::getTickFrequency();
+				const double stamp_delta = stamp_ms - last_stamp_ms_;
+				// Time stamps going back or leaping forward mean the camera restarted its clock: start over from this frame.
+				if (has_last_ && stamp_delta > 0 && stamp_delta < MAX_GAP_MS)
+				{
+					const double transit_delta = fabs(arrival_ms - last_arrival_ms_ - stamp_delta);
+					jitter_ms_ += (transit_delta - jitter_ms_) / 16;
+					jitter_us_.store((long long)(jitter_ms_ * 1000), std::memory_order_relaxed);
+
+					if (frame_rate > 0)
+					{
+						const long long missing = (long long)(stamp_delta * frame_rate / 1000 + 0.5) - 1;
+						if (missing > 0)
+							lost_.fetch_add((unsigned long long)missing, std::memory_order_relaxed);
+					}
+				}
+				has_last_ = true;
+				last_arrival_ms_ = arrival_ms;
+				last_stamp_ms_ = stamp_ms;
+			}
+
+			/*! Forget everything measured so far: the lost frames, the jitter, and the last frame,
+			 *	so that the next frame starts the estimates over rather than being compared to a frame before the reset.
+			 */
+			void Reset()
+			{
+				lost_ = 0;
+				jitter_us_ = 0;
+				restart_.store(true, std::memory_order_release);
+			}
+
+			//! Get the number of frames lost since the last reset.
+			unsigned long long GetLost() const { return lost_.load(std::memory_order_relaxed); }
+
+			//! Get the current jitter, in milliseconds.
+			double GetJitterMs() const { return jitter_us_.load(std::memory_order_relaxed) / 1000.; }
+
+		private:
+			//! Longest gap between time stamps counted as lost frames, rather than as a restart of the stream.
+			static const int MAX_GAP_MS = 10000;
+
+			bool has_last_;
+			double last_arrival_ms_;
+			double last_stamp_ms_;
+			double jitter_ms_;
+			//! Set by Reset() for Add() to forget the last frame and the smoothed jitter.
+			std::atomic<bool> restart_;
+
+			std::atomic<unsigned long long> lost_;
+			std::atomic<long long> jitter_us_;
+		};
+	}
+}
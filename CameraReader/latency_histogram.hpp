@@ -0,0 +1,153 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file latency_histogram.hpp
+ *	@brief Lock-free latency histogram, cheap enough to stay enabled in production.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <opencv2/core/core.hpp>
+
+#include <CameraReader/CameraReader/reader_stats.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CLatencyHistogram
+		 *	@brief Log-linear histogram of durations, in the manner of HdrHistogram.
+		 *
+		 *	Durations are counted in microseconds, in buckets 1/8 of a power of two wide,
+		 *	so 256 buckets cover up to hours with a relative error below 1/8.
+		 *	Recording costs a few relaxed atomic increments and no lock.
+		 *	The histogram fills whole cache lines of its own, so histograms of stages run by different threads never share one.
+		 */
+		class CLatencyHistogram
+		{
+		public:
+			CLatencyHistogram() { Reset(); }
+
+			/*! Record the time elapsed since the given cv::getTickCount() ticks.
+			 *	@param[in] start_tick	When the timed stage started.
+			 */
+			void RecordSince(long long start_tick)
+			{
+				Record((cv::getTickCount() - start_tick) * 1000. / cv::getTickFrequency());
+			}
+
+			/*! Record a duration.
+			 *	@param[in] ms	The duration in milliseconds.
+			 */
+			void Record(double ms)
+			{
+				const unsigned long long us = ms > 0 ? (unsigned long long)(ms * 1000) : 0;
+				buckets_[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+				count_.fetch_add(1, std::memory_order_relaxed);
+				sum_us_.fetch_add(us, std::memory_order_relaxed);
+				unsigned long long max_us = max_us_.load(std::memory_order_relaxed);
+				while (us > max_us && !max_us_.compare_exchange_weak(max_us, us, std::memory_order_relaxed));
+			}
+
+			/*! Summarize the recorded durations.
+			 *	@param[in] elapsed_sec	Seconds covered by the histogram, to compute the rate.
+			 */
+			StageStats GetStats(double elapsed_sec) const
+			{
+				StageStats stats;
+				stats.count = count_.load(std::memory_order_relaxed);
+				stats.per_sec = elapsed_sec > 0 ? stats.count / elapsed_sec : 0;
+				stats.mean_ms = stats.count ? sum_us_.load(std::memory_order_relaxed) / 1000. / stats.count : 0;
+				stats.max_ms = max_us_.load(std::memory_order_relaxed) / 1000.;
+
+				// Counts may move while we read them; the percentiles are taken against the sum we actually saw.
+				unsigned int counts[BUCKET_CNT];
+				unsigned long long total = 0;
+				for (int i = 0; i < BUCKET_CNT; ++i)
+					total += counts[i] = buckets_[i].load(std::memory_order_relaxed);
+				stats.p50_ms = Percentile(counts, total, 0.5);
+				stats.p90_ms = Percentile(counts, total, 0.9);
+				stats.p99_ms = Percentile(counts, total, 0.99);
+				return stats;
+			}
+
+			/*! Clear all recorded durations.
+			 *	Durations recorded concurrently may be partly kept.
+			 */
+			void Reset()
+			{
+				for (int i = 0; i < BUCKET_CNT; ++i)
+					buckets_[i] = 0;
+				count_ = 0;
+				sum_us_ = 0;
+				max_us_ = 0;
+			}
+
+		private:
+			//! Buckets per power of two.
+			enum { SUB_BUCKET_BITS = 3, SUB_BUCKET_CNT = 1 << SUB_BUCKET_BITS, BUCKET_CNT = 256 };
+
+			static int BucketOf(unsigned long long us)
+			{
+				if (us < SUB_BUCKET_CNT)
+					return (int)us;
+				int msb = SUB_BUCKET_BITS;
+				while (us >> (msb + 1))
+					++msb;
+				const int idx = (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_CNT + (int)((us >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_CNT - 1));
+				return idx < BUCKET_CNT ? idx : BUCKET_CNT - 1;
+			}
+
+			//! Middle of the durations counted in a bucket, in microseconds.
+			static double MiddleOf(int idx)
+			{
+				if (idx < SUB_BUCKET_CNT)
+					return idx + 0.5;
+				const int shift = idx / SUB_BUCKET_CNT - 1;
+				return (SUB_BUCKET_CNT + idx % SUB_BUCKET_CNT + 0.5) * (1ull << shift);
+			}
+
+			static double Percentile(const unsigned int* counts, unsigned long long total, double quantile)
+			{
+				if (!total)
+					return 0;
+				const unsigned long long rank = (unsigned long long)(quantile * (total - 1)) + 1;
+				unsigned long long seen = 0;
+				for (int i = 0; i < BUCKET_CNT; ++i)
+				{
+					seen += counts[i];
+					if (seen >= rank)
+						return MiddleOf(i) / 1000.;
+				}
+				return MiddleOf(BUCKET_CNT - 1) / 1000.;
+			}
+
+			std::atomic<unsigned int> buckets_[BUCKET_CNT];
+			std::atomic<unsigned long long> count_;
+			std::atomic<unsigned long long> sum_us_;
+			std::atomic<unsigned long long> max_us_;
+			//! Keeps the next object off the last cache line of this one.
+			char padding_[64];
+		};
+	}
+}
@@ -0,0 +1,273 @@
+#include <cstddef>
+#include <cstdio>
+#include <chrono>
+
+#include <CameraReader/CameraReader/logger.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		//! Number of records the queue holds. A power of 2.
+		const size_t LOG_QUEUE_SIZE = 1024;
+		//! Number of message types rate-limited separately. Further types are not limited.
+		const size_t LOG_TYPE_CNT = 64;
+		//! Number of messages of a type printed per LOG_WINDOW.
+		const int LOG_BURST = 5;
+		//! Window of the rate limit.
+		const milliseconds LOG_WINDOW(1000);
+		//! How often the logger thread looks for new records.
+		const milliseconds LOG_POLL(50);
+
+		struct LogRecord
+		{
+			LogLevel level;
+			const char* format;
+			long long values[CLogger::MAX_ARGS];
+		};
+
+		/*! Cell of the record queue.
+		 *	The queue is the bounded multi-producer queue of Dmitry Vyukov:
+		 *	a producer claims a position, then publishes the cell through its sequence number.
+		 */
+		struct LogCell
+		{
+			//! Equals the position of the cell when it is free for a producer, and the position + 1 when it holds a record.
+			atomic<size_t> seq;
+			LogRecord record;
+		};
+
+		//! Rate limit of one message type.
+		struct LogType
+		{
+			//! The format string of the type, or NULL for a free entry.
+			atomic<const char*> format;
+			//! Start of the current window, in steady_clock ticks.
+			atomic<long long> window_start;
+			//! Number of messages of the type in the current window.
+			atomic<int> window_cnt;
+			//! Number of messages suppressed since the last report.
+			atomic<unsigned long long> suppressed;
+		};
+
+		struct LogQueue
+		{
+			LogCell cells[LOG_QUEUE_SIZE];
+			atomic<size_t> enqueue_pos;
+			atomic<size_t> dequeue_pos;
+			LogType types[LOG_TYPE_CNT];
+			atomic<int> level;
+			atomic<unsigned long long> dropped;
+			//! Dropped messages already reported.
+			unsigned long long reported_dropped;
+
+			LogQueue() : enqueue_pos(0), dequeue_pos(0), level(LOG_INFO), dropped(0), reported_dropped(0)
+			{
+				for (size_t i = 0; i < LOG_QUEUE_SIZE; ++i)
+					cells[i].seq = i;
+				for (size_t i = 0; i < LOG_TYPE_CNT; ++i)
+				{
+					types[i].format = NULL;
+					types[i].window_start = 0;
+					types[i].window_cnt = 0;
+					types[i].suppressed = 0;
+				}
+			}
+
+			//! Find the entry of a message type, adding it if new.
+			LogType* FindType(const char* format)
+			{
+				size_t idx = (size_t(format) >> 3) % LOG_TYPE_CNT;
+				for (size_t i = 0; i < LOG_TYPE_CNT; ++i, idx = (idx + 1) % LOG_TYPE_CNT)
+				{
+					const char* key = types[idx].format.load();
+					// A failed exchange loads the type that took the entry meanwhile, which may be this one.
+					if ((!key && types[idx].format.compare_exchange_strong(key, format)) || key == format)
+						return &types[idx];
+				}
+				return NULL;
+			}
+		};
+
+		// Initialized when the library is loaded, before any reader exists.
+		LogQueue g_log_queue;
+
+		mutex g_logger_lock;
+		weak_ptr<CLogger> g_logger;
+
+		static const char* LevelName(LogLevel level)
+		{
+			switch (level)
+			{
+			case LOG_DEBUG:
+				return "DEBUG";
+			case LOG_INFO:
+				return "INFO";
+			case LOG_WARNING:
+				return "WARNING";
+			default:
+				return "ERROR";
+			}
+		}
+
+		shared_ptr<CLogger> CLogger::Acquire()
+		{
+			lock_guard<mutex> guard(g_logger_lock);
+			shared_ptr<CLogger> logger = g_logger.lock();
+			if (!logger)
+			{
+				logger = make_shared<CLogger>();
+				g_logger = logger;
+			}
+			return logger;
+		}
+
+		CLogger::CLogger() : stopping_(false)
+		{
+			runner_ = thread([this] { Run(); });
+		}
+
+		CLogger::~CLogger()
+		{
+			{
+				lock_guard<mutex> guard(lock_);
+				stopping_ = true;
+			}
+			stop_.notify_one();
+			runner_.join();
+		}
+
+		void CLogger::SetLevel(LogLevel level)
+		{
+			g_log_queue.level = level;
+		}
+
+		unsigned long long CLogger::GetDropped()
+		{
+			return g_log_queue.dropped;
+		}
+
+		void CLogger::Enqueue(LogLevel level, const char* format, const long long* values)
+		{
+			LogQueue& queue = g_log_queue;
+			if (level < queue.level.load())
+				return;
+
+			LogType* type = queue.FindType(format);
+			if (type)
+			{
+				const long long now = steady_clock::now().time_since_epoch().count();
+				long long window_start = type->window_start.load();
+				if (now - window_start >= steady_clock::duration(LOG_WINDOW).count()
+					&& type->window_start.compare_exchange_strong(window_start, now))
+					type->window_cnt = 0;
+				if (++type->window_cnt > LOG_BURST)
+				{
+					++type->suppressed;
+					return;
+				}
+			}
+
+			size_t pos = queue.enqueue_pos.load();
+			for (;;)
+			{
+				LogCell& cell = queue.cells[pos % LOG_QUEUE_SIZE];
+				const ptrdiff_t lag = ptrdiff_t(cell.seq.load() - pos);
+				if (!lag)
+				{
+					if (queue.enqueue_pos.compare_exchange_weak(pos, pos + 1))
+					{
+						cell.record.level = level;
+						cell.record.format = format;
+						for (int i = 0; i < MAX_ARGS; ++i)
+							cell.record.values[i] = values[i];
+						cell.seq = pos + 1;
+						return;
+					}
+				}
+				else if (lag < 0)
+				{
+					// The logger thread is behind by a whole queue; never wait for it here.
+					++queue.dropped;
+					return;
+				}
+				else
+					pos = queue.enqueue_pos.load();
+			}
+		}
+
+		void CLogger::Run()
+		{
+			steady_clock::time_point last_report = steady_clock::now();
+			unique_lock<mutex> guard(lock_);
+			while (!stopping_)
+			{
+				stop_.wait_for(guard, LOG_POLL, [this] { return stopping_; });
+				guard.unlock();
+				Drain();
+				if (steady_clock::now() - last_report >= LOG_WINDOW)
+				{
+					ReportSuppressed();
+					last_report = steady_clock::now();
+				}
+				guard.lock();
+			}
+			guard.unlock();
+			Drain();
+			ReportSuppressed();
+		}
+
+		void CLogger::Drain()
+		{
+			LogQueue& queue = g_log_queue;
+			bool printed = false;
+			for (;;)
+			{
+				// Only this thread dequeues, so the position is not contended.
+				const size_t pos = queue.dequeue_pos.load();
+				LogCell& cell = queue.cells[pos % LOG_QUEUE_SIZE];
+				if (cell.seq.load() != pos + 1)
+					break;
+
+				const LogRecord record = cell.record;
+				cell.seq = pos + LOG_QUEUE_SIZE;
+				queue.dequeue_pos = pos + 1;
+
+				FILE* out = record.level >= LOG_WARNING ? stderr : stdout;
+				fprintf(out, "[CameraReader %s] ", LevelName(record.level));
+				fprintf(out, record.format, record.values[0], record.values[1], record.values[2]);
+				fputc('\n', out);
+				printed = true;
+			}
+			if (printed)
+			{
+				fflush(stdout);
+				fflush(stderr);
+			}
+		}
+
+		void CLogger::ReportSuppressed()
+		{
+			LogQueue& queue = g_log_queue;
+			for (size_t i = 0; i < LOG_TYPE_CNT; ++i)
+			{
+				const char* format = queue.types[i].format.load();
+				if (!format)
+					continue;
+				const unsigned long long suppressed = queue.types[i].suppressed.exchange(0);
+				if (suppressed)
+					fprintf(stderr, "[CameraReader WARNING] %llu more messages suppressed: %s\n", suppressed, format);
+			}
+
+			const unsigned long long dropped = queue.dropped.load();
+			if (dropped != queue.reported_dropped)
+			{
+				fprintf(stderr, "[CameraReader WARNING] %llu messages lost because the log queue was full.\n", dropped - queue.reported_dropped);
+				queue.reported_dropped = dropped;
+			}
+		}
+	}
+}
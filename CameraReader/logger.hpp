@@ -0,0 +1,110 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file logger.hpp
+ *	@brief Asynchronous, rate-limited logging for the capture and decode paths.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		//! Severity of a log message.
+		enum LogLevel
+		{
+			LOG_DEBUG,
+			LOG_INFO,
+			LOG_WARNING,
+			LOG_ERROR
+		};
+
+		/*!	@class CLogger
+		 *	@brief Hands log messages over to a background thread, which formats and prints them.
+		 *
+		 *	Log() only copies a fixed-size record into a lock-free queue, so it can be called from SDK callbacks
+		 *	and decode workers without waiting for the console or for each other.
+		 *	Each format string is a message type, printed at most a few times a second;
+		 *	the rest are counted and reported once a second instead of flooding the console.
+		 *	Records are queued even while nobody holds the logger, and printed once somebody does.
+		 */
+		class CLogger
+		{
+		public:
+			//! Maximum number of arguments of a message.
+			enum { MAX_ARGS = 3 };
+
+			/*! Get the shared logger, starting its thread if nobody holds it.
+			 *	@return	The logger, which prints all queued records and stops once the last holder releases it.
+			 */
+			static std::shared_ptr<CLogger> Acquire();
+
+			//! Use Acquire() instead, so that only one thread prints.
+			CLogger();
+			~CLogger();
+
+			/*! Queue a message.
+			 *	@param[in]	level	The severity of the message. Messages below the level set by SetLevel() are discarded.
+			 *	@param[in]	format	A string literal in printf() format, with %lld for each argument.
+			 *						Its address tells message types apart.
+			 *	@param[in]	args	Integer arguments, at most MAX_ARGS.
+			 */
+			template <typename... Args>
+			static void Log(LogLevel level, const char* format, Args... args)
+			{
+				static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments for a log message.");
+				const long long values[MAX_ARGS] = { static_cast<long long>(args)... };
+				Enqueue(level, format, values);
+			}
+
+			//! Set the lowest severity printed. LOG_INFO by default.
+			static void SetLevel(LogLevel level);
+
+			/*! Get the number of messages lost because the queue was full.
+			 *	Messages suppressed by the rate limit are not counted.
+			 */
+			static unsigned long long GetDropped();
+
+		private:
+			static void Enqueue(LogLevel level, const char* format, const long long* values);
+
+			//! Print queued records until stopped, then print the rest.
+			void Run();
+			//! Print all queued records.
+			void Drain();
+			//! Report the messages suppressed by the rate limit or dropped since the last report.
+			void ReportSuppressed();
+
+			std::thread runner_;
+			//! Guards stopping_ against the wait of runner_.
+			std::mutex lock_;
+			std::condition_variable stop_;
+			bool stopping_;
+		};
+	}
+}
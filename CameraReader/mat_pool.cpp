@@ -0,0 +1,57 @@
+#include <CameraReader/CameraReader/mat_pool.hpp>
+
+using namespace std;
+using namespace cv;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		CMatPool::CMatPool(size_t max_per_shape, size_t max_shapes) :
+			max_per_shape_(max_per_shape), max_shapes_(max_shapes ? max_shapes : 1), use_clock_(0)
+		{
+			shapes_.reserve(max_shapes_);
+		}
+
+		Mat CMatPool::Acquire(int rows, int cols, int type)
+		{
+			++use_clock_;
+
+			size_t idx = 0;
+			while (idx < shapes_.size() && (shapes_[idx].rows != rows || shapes_[idx].cols != cols || shapes_[idx].type != type))
+				++idx;
+
+			if (idx == shapes_.size())
+			{
+				if (shapes_.size() < max_shapes_)
+					shapes_.push_back(Shape());
+				else
+				{
+					// Recycle the entry of the least recently used shape.
+					idx = 0;
+					for (size_t i = 1; i < shapes_.size(); ++i)
+						if (shapes_[i].last_use < shapes_[idx].last_use)
+							idx = i;
+					shapes_[idx].bufs.clear();
+				}
+				shapes_[idx].rows = rows;
+				shapes_[idx].cols = cols;
+				shapes_[idx].type = type;
+			}
+			shapes_[idx].last_use = use_clock_;
+
+			vector<Mat>& bufs = shapes_[idx].bufs;
+			for (size_t i = 0; i < bufs.size(); ++i)
+			{
+				// Only the pool refers to the buffer, and nobody can get a new reference but us.
+				if (*bufs[i].refcount == 1)
+					return bufs[i];
+			}
+
+			Mat buf(rows, cols, type);
+			if (bufs.size() < max_per_shape_)
+				bufs.push_back(buf);
+			return buf;
+		}
+	}
+}
@@ -0,0 +1,83 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file mat_pool.hpp
+ *	@brief Pool of reusable image buffers.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CMatPool
+		 *	@brief Pool of image buffers keyed by width, height and type.
+		 *
+		 *	A buffer handed out by Acquire() goes back to the pool by itself once every header referring to it is released,
+		 *	so callers simply drop their cv::Mat as usual.
+		 *	A stream of same-sized frames therefore settles on a few buffers per shape and stops allocating.
+		 *	A pool is meant to be used from one thread, while the buffers it hands out may be released from any thread.
+		 */
+		class CMatPool
+		{
+		public:
+			/*! Constructor of CMatPool.
+			 *	@param[in]	max_per_shape	Maximum number of buffers kept for each shape.
+			 *								Buffers requested beyond that are allocated normally and not kept.
+			 *	@param[in]	max_shapes		Maximum number of shapes kept. The least recently used shape is dropped beyond that.
+			 */
+			explicit CMatPool(size_t max_per_shape = 4, size_t max_shapes = 8);
+
+			/*! Get a buffer of the given shape that nobody else refers to.
+			 *	Its content is undefined.
+			 *	@return	The buffer.
+			 */
+			cv::Mat Acquire(int rows, int cols, int type);
+
+			/*! Drop all buffers kept by the pool.
+			 *	Buffers still in use stay valid for their holders.
+			 */
+			void Clear() { shapes_.clear(); }
+
+		private:
+			struct Shape
+			{
+				int rows;
+				int cols;
+				int type;
+				//! Value of use_clock_ when the shape was last requested.
+				unsigned long long last_use;
+				std::vector<cv::Mat> bufs;
+			};
+
+			size_t max_per_shape_;
+			size_t max_shapes_;
+			//! Counts requests, to find the least recently used shape.
+			unsigned long long use_clock_;
+			std::vector<Shape> shapes_;
+		};
+	}
+}
@@ -0,0 +1,163 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file packet_queue.hpp
+ *	@brief Lock-free hand-off of stream packets from a network thread to a decode worker.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CPacketQueue
+		 *	@brief Bounded FIFO of variable-sized packets between one producer thread and one consumer thread.
+		 *
+		 *	Packets are copied into an arena allocated once, so pushing never allocates, locks or waits.
+		 *	When the arena or the packet slots are full, the new packet is dropped and counted instead,
+		 *	which leaves the producer, typically a network thread shared by many streams, running at full speed.
+		 */
+		class CPacketQueue
+		{
+		public:
+			//! A queued packet, whose data stays valid until Pop().
+			struct Packet
+			{
+				unsigned long type;
+				const unsigned char* data;
+				size_t size;
+			};
+
+			/*! Constructor of CPacketQueue.
+			 *	@param[in]	arena_size	Bytes of packet data the queue holds at most.
+			 *	@param[in]	max_packets	Number of packets the queue holds at most.
+			 */
+			CPacketQueue(size_t arena_size, size_t max_packets) :
+				arena_(arena_size), slots_(max_packets ? max_packets : 1), head_(0), tail_(0), arena_read_(0), arena_write_(0), pushed_(0), dropped_(0)
+			{
+			}
+
+			/*! Copy a packet into the queue.
+			 *	Only the producer thread may call this.
+			 *	A packet larger than half the arena may not fit even in an empty queue, depending on where the last one ended.
+			 *	@return	False if the queue was full, in which case the packet is dropped.
+			 */
+			bool Push(unsigned long type, const unsigned char* data, size_t size)
+			{
+				const unsigned long long tail = tail_.load(std::memory_order_relaxed);
+				if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+					return Drop();
+
+				// Keep each packet contiguous: one that does not fit before the end of the arena goes to its start.
+				unsigned long long write = arena_write_;
+				size_t offset = size_t(write % arena_.size());
+				if (offset + size > arena_.size())
+				{
+					write += arena_.size() - offset;
+					offset = 0;
+				}
+				if (write + size - arena_read_.load(std::memory_order_acquire) > arena_.size())
+					return Drop();
+
+				memcpy(&arena_[offset], data, size);
+				Slot& slot = slots_[size_t(tail % slots_.size())];
+				slot.type = type;
+				slot.offset = offset;
+				slot.size = size;
+				slot.end = write + size;
+				arena_write_ = slot.end;
+				++pushed_;
+				tail_.store(tail + 1, std::memory_order_release);
+				return true;
+			}
+
+			/*! Get the oldest packet without removing it.
+			 *	Only the consumer thread may call this.
+			 *	@return	False if the queue is empty.
+			 */
+			bool Front(Packet& packet) const
+			{
+				const unsigned long long head = head_.load(std::memory_order_relaxed);
+				if (head == tail_.load(std::memory_order_acquire))
+					return false;
+				const Slot& slot = slots_[size_t(head % slots_.size())];
+				packet.type = slot.type;
+				packet.data = &arena_[slot.offset];
+				packet.size = slot.size;
+				return true;
+			}
+
+			/*! Remove the packet returned by Front(), and give its space back to the producer.
+			 *	Only the consumer thread may call this.
+			 */
+			void Pop()
+			{
+				const unsigned long long head = head_.load(std::memory_order_relaxed);
+				arena_read_.store(slots_[size_t(head % slots_.size())].end, std::memory_order_release);
+				head_.store(head + 1, std::memory_order_release);
+			}
+
+			//! Check whether no packet is queued.
+			bool Empty() const { return head_.load() == tail_.load(); }
+
+			//! Number of packets queued since construction.
+			unsigned long long GetPushed() const { return pushed_.load(std::memory_order_relaxed); }
+			//! Number of packets dropped since construction because the queue was full.
+			unsigned long long GetDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+		private:
+			struct Slot
+			{
+				unsigned long type;
+				size_t offset;
+				size_t size;
+				//! Arena position right after the packet, counting the space skipped to keep it contiguous.
+				unsigned long long end;
+			};
+
+			bool Drop()
+			{
+				++dropped_;
+				return false;
+			}
+
+			std::vector<unsigned char> arena_;
+			std::vector<Slot> slots_;
+
+			//! Number of packets popped, written by the consumer.
+			std::atomic<unsigned long long> head_;
+			//! Number of packets pushed, written by the producer.
+			std::atomic<unsigned long long> tail_;
+			//! Arena position up to which the consumer is done, written by the consumer.
+			std::atomic<unsigned long long> arena_read_;
+			//! Arena position where the next packet goes, used by the producer only.
+			unsigned long long arena_write_;
+
+			std::atomic<unsigned long long> pushed_;
+			std::atomic<unsigned long long> dropped_;
+		};
+	}
+}
@@ -0,0 +1,118 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file reader_stats.hpp
+ *	@brief Latency and throughput counters of camera readers.
+ */
+
+#pragma once
+
+#include <CameraReader/CameraReader/frame_ring_stats.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@enum ReaderStage
+		 *	@brief Stages of the way of a frame from the camera to the caller, timed by each reader.
+		 */
+		enum ReaderStage
+		{
+			//! Feeding a stream packet to PlayM4_InputData(), retries included. HikVision SDK only.
+			STAGE_INPUT_DATA,
+			//! Getting a decoded image: PlayM4_GetBMP() for web cameras, VideoCapture::retrieve() for OpenCV captures.
+			STAGE_DECODE,
+			//! Waiting in GetImage() for a frame.
+			STAGE_WAIT,
+			//! Converting the channels of an image in CCamReader::GetImage(int, int, int, bool, bool, int).
+			STAGE_CONVERT,
+			//! Cropping and resizing an image in CCamReader::GetImage(int, int, int, bool, bool, int), including the conversion of YUV frames.
+			STAGE_RESIZE,
+			//! Flipping an image in CCamReader::GetImage(int, int, int, bool, bool, int).
+			STAGE_FLIP,
+			//! Balance(). As it is not tied to a reader, every reader reports the calls of the whole process.
+			STAGE_BALANCE,
+			//! Number of stages.
+			STAGE_CNT
+		};
+
+		/*!	@struct StageStats
+		 *	@brief Latency distribution and rate of one stage.
+		 *
+		 *	Percentiles are accurate to about 1/8 of their value.
+		 */
+		struct StageStats
+		{
+			//! Number of times the stage ran.
+			unsigned long long count;
+			//! Times per second the stage ran since the counters were reset.
+			double per_sec;
+			double mean_ms;
+			double p50_ms;
+			double p90_ms;
+			double p99_ms;
+			double max_ms;
+		};
+
+		/*!	@struct ReaderStats
+		 *	@brief Snapshot of the counters of a reader.
+		 */
+		struct ReaderStats
+		{
+			//! Seconds covered by the counters.
+			double elapsed_sec;
+			//! Latency of each stage, indexed by ReaderStage.
+			StageStats stages[STAGE_CNT];
+			//! Frames produced for the reader, by its decoder or its capture.
+			unsigned long long frames_produced;
+			//! Frames returned by GetImage(), repeats excluded.
+			unsigned long long frames_returned;
+			//! Frames of the stream GetImage() skipped, because a newer one was produced before it was called again.
+			unsigned long long frames_skipped;
+			//! Times PlayM4_InputData() was retried because the decoder was busy. HikVision SDK only.
+			unsigned long long input_retries;
+			//! Stream packets or frames lost to decoder errors. HikVision SDK only.
+			unsigned long long decode_errors;
+			/*! Stream packets dropped because the decoder fell behind and filled the packet queue. HikVision SDK only.
+			 *	The decoder skips the damaged data up to the next key frame.
+			 */
+			unsigned long long packets_dropped;
+			/*! Frames the camera sent but the reader never received, told by gaps in their time stamps.
+			 *	Counted for the HikVision SDK, and for RTSP while a delivery thread grabs the stream.
+			 */
+			unsigned long long frames_lost;
+			//! Interarrival jitter of the frames in milliseconds, as defined by RFC 3550. Measured like frames_lost.
+			double jitter_ms;
+			//! Times the stream was connected again after it dropped. Web cameras only.
+			unsigned long long reconnects;
+			//! How long ago the newest frame was captured, in milliseconds, or -1 if none was.
+			double frame_age_ms;
+			//! Times the newest frame got older than the limit of CCamReader::SetFreshnessSlo().
+			unsigned long long stalls;
+			//! Milliseconds spent stalled, the current stall included.
+			double stalled_ms;
+			//! Length of the longest stall in milliseconds, the current one included.
+			double longest_stall_ms;
+			//! Counters of the frame queue.
+			FrameRingStats queue;
+		};
+	}
+}
@@ -0,0 +1,246 @@
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <CameraReader/CameraReader/resize_yuv.hpp>
+
+// The NoSSE configurations define _NO_SSE, since x64 compilers assume SSE2 whatever the target instruction set.
+#if !defined(_NO_SSE) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESIZE_YUV_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		namespace
+		{
+			//! Fixed-point BT.601 coefficients of the conversion, in units of 1/8192.
+			enum
+			{
+				COEF_Y = 9535,		// 1.164
+				COEF_UB = 16525,	// 2.017
+				COEF_UG = -3203,	// -0.391
+				COEF_VG = -6660,	// -0.813
+				COEF_VR = 13074		// 1.596
+			};
+
+			//! Weight of a whole sample in horizontal interpolation.
+			const int H_WEIGHT_ONE = 256;
+			//! Weight of a whole sample in vertical interpolation, small enough to keep the products within 16 bits.
+			const int V_WEIGHT_ONE = 128;
+
+			//! The two source samples around an output sample, with the weight of the second one.
+			struct Tap
+			{
+				int first;
+				int second;
+				int weight;
+			};
+
+			/*! Map each output sample to the source samples around it, with pixel centers aligned like cv::resize().
+			 *	@param[in]	origin		Start of the sampled region, in source samples.
+			 *	@param[in]	scale		Source samples per output sample.
+			 *	@param[in]	src_size	Number of source samples.
+			 *	@param[in]	dst_size	Number of output samples.
+			 *	@param[in]	weight_one	Weight of a whole sample.
+			 *	@param[in]	mirror		Whether to map the output in reverse order.
+			 *	@param[out]	taps		Receives one tap per output sample.
+			 */
+			void MapTaps(double origin, double scale, int src_size, int dst_size, int weight_one, bool mirror, vector<Tap>& taps)
+			{
+				taps.resize(dst_size);
+				for (int i = 0; i < dst_size; ++i)
+				{
+					const double pos = origin + (i + 0.5) * scale - 0.5;
+					Tap& tap = taps[mirror ? dst_size - 1 - i : i];
+					tap.first = (int)floor(pos);
+					tap.weight = (int)((pos - tap.first) * weight_one + 0.5);
+					if (tap.first < 0)
+					{
+						tap.first = 0;
+						tap.weight = 0;
+					}
+					else if (tap.first >= src_size - 1)
+					{
+						tap.first = src_size - 1;
+						tap.weight = 0;
+					}
+					tap.second = min(tap.first + 1, src_size - 1);
+				}
+			}
+
+			/*! Interpolate a source row at the given taps.
+			 *	@param[in]	row		The first sample of the row.
+			 *	@param[in]	step	Bytes between two samples, i.e. 2 for interleaved chroma.
+			 *	@param[in]	taps	The taps of the output samples.
+			 *	@param[out]	out		Receives one sample per tap.
+			 */
+			void ResampleRow(const uchar* row, int step, const vector<Tap>& taps, short* out)
+			{
+				for (size_t i = 0; i < taps.size(); ++i)
+				{
+					const Tap& tap = taps[i];
+					out[i] = (short)((row[tap.first * step] * (H_WEIGHT_ONE - tap.weight) + row[tap.second * step] * tap.weight + H_WEIGHT_ONE / 2) >> 8);
+				}
+			}
+
+			//! Interpolate between two resampled rows.
+			void BlendRows(const short* upper, const short* lower, int weight, int cnt, short* out)
+			{
+				int i = 0;
+#ifdef RESIZE_YUV_SSE2
+				const __m128i w = _mm_set1_epi16((short)weight);
+				for (; i + 8 <= cnt; i += 8)
+				{
+					const __m128i a = _mm_loadu_si128((const __m128i*)(upper + i));
+					const __m128i b = _mm_loadu_si128((const __m128i*)(lower + i));
+					_mm_storeu_si128((__m128i*)(out + i), _mm_add_epi16(a, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), w), 7)));
+				}
+#endif
+				for (; i < cnt; ++i)
+					out[i] = (short)(upper[i] + (((lower[i] - upper[i]) * weight) >> 7));
+			}
+
+			//! High half of a 16-bit product, like _mm_mulhi_epi16().
+			inline int MulHigh(int a, int b)
+			{
+				return (a * b) >> 16;
+			}
+
+			//! Drop the 4 fractional bits of a color component and clamp it to a byte.
+			inline uchar Descale(int value)
+			{
+				value = (value + 8) >> 4;
+				return (uchar)(value < 0 ? 0 : value > 255 ? 255 : value);
+			}
+
+			/*! Convert a row of YUV samples into BGR or BGRA pixels.
+			 *	The SIMD and the scalar paths compute exactly the same values.
+			 */
+			void ConvertRow(const short* y, const short* u, const short* v, int cnt, int channels, uchar* out)
+			{
+				int i = 0;
+#ifdef RESIZE_YUV_SSE2
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i y_offset = _mm_set1_epi16(16), uv_offset = _mm_set1_epi16(128), rounding = _mm_set1_epi16(8);
+				const __m128i coef_y = _mm_set1_epi16(COEF_Y), coef_ub = _mm_set1_epi16(COEF_UB), coef_ug = _mm_set1_epi16(COEF_UG);
+				const __m128i coef_vg = _mm_set1_epi16(COEF_VG), coef_vr = _mm_set1_epi16(COEF_VR);
+				const __m128i alpha = _mm_set1_epi8((char)255);
+				for (; i + 8 <= cnt; i += 8)
+				{
+					const __m128i luma = _mm_loadu_si128((const __m128i*)(y + i));
+					const __m128i ys = _mm_mulhi_epi16(_mm_slli_epi16(_mm_max_epi16(_mm_sub_epi16(luma, y_offset), zero), 7), coef_y);
+					const __m128i us = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*)(u + i)), uv_offset), 7);
+					const __m128i vs = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*)(v + i)), uv_offset), 7);
+
+					__m128i b = _mm_add_epi16(ys, _mm_mulhi_epi16(us, coef_ub));
+					__m128i g = _mm_add_epi16(ys, _mm_add_epi16(_mm_mulhi_epi16(us, coef_ug), _mm_mulhi_epi16(vs, coef_vg)));
+					__m128i r = _mm_add_epi16(ys, _mm_mulhi_epi16(vs, coef_vr));
+					b = _mm_srai_epi16(_mm_add_epi16(b, rounding), 4);
+					g = _mm_srai_epi16(_mm_add_epi16(g, rounding), 4);
+					r = _mm_srai_epi16(_mm_add_epi16(r, rounding), 4);
+
+					const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+					const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+					const __m128i low = _mm_unpacklo_epi16(bg, ra), high = _mm_unpackhi_epi16(bg, ra);
+					if (channels == 4)
+					{
+						_mm_storeu_si128((__m128i*)(out + i * 4), low);
+						_mm_storeu_si128((__m128i*)(out + i * 4 + 16), high);
+					}
+					else
+					{
+						// SSE2 cannot shuffle bytes, so the alpha channel is dropped while copying out.
+						uchar bgra[32];
+						_mm_storeu_si128((__m128i*)bgra, low);
+						_mm_storeu_si128((__m128i*)(bgra + 16), high);
+						for (int k = 0; k < 8; ++k)
+						{
+							out[(i + k) * 3] = bgra[k * 4];
+							out[(i + k) * 3 + 1] = bgra[k * 4 + 1];
+							out[(i + k) * 3 + 2] = bgra[k * 4 + 2];
+						}
+					}
+				}
+#endif
+				for (; i < cnt; ++i)
+				{
+					const int ys = MulHigh(max(y[i] - 16, 0) << 7, COEF_Y);
+					const int us = (u[i] - 128) * 128, vs = (v[i] - 128) * 128;
+					uchar* pixel = out + i * channels;
+					pixel[0] = Descale(ys + MulHigh(us, COEF_UB));
+					pixel[1] = Descale(ys + MulHigh(us, COEF_UG) + MulHigh(vs, COEF_VG));
+					pixel[2] = Descale(ys + MulHigh(vs, COEF_VR));
+					if (channels == 4)
+						pixel[3] = 255;
+				}
+			}
+		}
+
+		void ResizeYuv(const YuvPlanes& src, const Rect& roi, Mat& dst, bool flip_x, bool flip_y)
+		{
+			const int width = dst.cols, height = dst.rows, channels = dst.channels();
+			// E.g. the inner rectangle of a letterbox narrower than a pixel.
+			if (dst.empty() || width <= 0 || height <= 0)
+				return;
+			const double scale_x = double(roi.width) / width, scale_y = double(roi.height) / height;
+
+			vector<Tap> luma_cols, luma_rows, chroma_cols, chroma_rows;
+			MapTaps(roi.x, scale_x, src.y.cols, width, H_WEIGHT_ONE, flip_x, luma_cols);
+			MapTaps(roi.y, scale_y, src.y.rows, height, V_WEIGHT_ONE, flip_y, luma_rows);
+			if (channels != 1)
+			{
+				// Each chroma sample sits at the center of the 2x2 luma samples it covers.
+				MapTaps(roi.x / 2., scale_x / 2, src.u.cols, width, H_WEIGHT_ONE, flip_x, chroma_cols);
+				MapTaps(roi.y / 2., scale_y / 2, src.u.rows, height, V_WEIGHT_ONE, flip_y, chroma_rows);
+			}
+
+			// The U and V samples are interleaved in src.u with PIXEL_NV12.
+			const bool interleaved = src.format == PIXEL_NV12;
+			const Mat& v_plane = interleaved ? src.u : src.v;
+			const int chroma_step = interleaved ? 2 : 1, v_offset = interleaved ? 1 : 0;
+
+			// Resampled upper and lower source rows, then blended rows, of Y, U and V.
+			vector<short> rows(width * 9);
+			short* upper_y = &rows[0];
+			short* lower_y = upper_y + width;
+			short* upper_u = lower_y + width;
+			short* lower_u = upper_u + width;
+			short* upper_v = lower_u + width;
+			short* lower_v = upper_v + width;
+			short* y = lower_v + width;
+			short* u = y + width;
+			short* v = u + width;
+
+			for (int r = 0; r < height; ++r)
+			{
+				const Tap& luma_row = luma_rows[r];
+				ResampleRow(src.y.ptr(luma_row.first), 1, luma_cols, upper_y);
+				ResampleRow(src.y.ptr(luma_row.second), 1, luma_cols, lower_y);
+				BlendRows(upper_y, lower_y, luma_row.weight, width, y);
+
+				uchar* out = dst.ptr(r);
+				if (channels == 1)
+				{
+					for (int i = 0; i < width; ++i)
+						out[i] = (uchar)y[i];
+					continue;
+				}
+
+				const Tap& chroma_row = chroma_rows[r];
+				ResampleRow(src.u.ptr(chroma_row.first), chroma_step, chroma_cols, upper_u);
+				ResampleRow(src.u.ptr(chroma_row.second), chroma_step, chroma_cols, lower_u);
+				ResampleRow(v_plane.ptr(chroma_row.first) + v_offset, chroma_step, chroma_cols, upper_v);
+				ResampleRow(v_plane.ptr(chroma_row.second) + v_offset, chroma_step, chroma_cols, lower_v);
+				BlendRows(upper_u, lower_u, chroma_row.weight, width, u);
+				BlendRows(upper_v, lower_v, chroma_row.weight, width, v);
+				ConvertRow(y, u, v, width, channels, out);
+			}
+		}
+	}
+}
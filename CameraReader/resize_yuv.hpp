@@ -0,0 +1,48 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file resize_yuv.hpp
+ *	@brief Conversion of planar YUV frames fused with cropping, resizing and flipping.
+ */
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include <CameraReader/CameraReader/frame.hpp>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*! Convert a region of YUV 4:2:0 planes into packed pixels of another size, in a single pass over the output.
+		 *	Only the source samples around each output pixel are read. They are interpolated bilinearly like cv::resize() does,
+		 *	and converted with the BT.601 coefficients of cv::cvtColor(), so downscaling costs about as much as the output size,
+		 *	instead of a conversion of the whole frame followed by a resize.
+		 *	@param[in]	src		The source planes.
+		 *	@param[in]	roi		The region of the source to sample, in pixels of the Y plane.
+		 *	@param[out]	dst		The output, allocated by the caller as CV_8UC1, CV_8UC3 or CV_8UC4 of any size. All its pixels are written. An empty output is left alone.
+		 *	@param[in]	flip_x	Whether to mirror the output left to right, i.e. around the y-axis.
+		 *	@param[in]	flip_y	Whether to mirror the output upside down, i.e. around the x-axis.
+		 */
+		void ResizeYuv(const YuvPlanes& src, const cv::Rect& roi, cv::Mat& dst, bool flip_x, bool flip_y);
+	}
+}
@@ -0,0 +1,153 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file slot_table.hpp
+ *	@brief Fixed-size, lock-free table mapping small integer keys to objects.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CSlotTable
+		 *	@brief Table of pointers indexed by slot number, for looking objects up from SDK callbacks.
+		 *
+		 *	SDK callbacks only carry an integer of user data, so each object takes a slot and passes its number instead.
+		 *	A lookup is a CLookup, which counts itself on its slot for as long as it lives,
+		 *	and never waits for slots being taken or freed. Remove() waits for the lookups of the slot instead,
+		 *	so that an object is never destroyed under a callback still using it.
+		 *	The table never grows, so lookups never race with a reallocation.
+		 */
+		template <typename T, size_t N>
+		class CSlotTable
+		{
+		public:
+			/*!	@class CLookup
+			 *	@brief The object in a slot, which stays in the table at least until the lookup is destroyed.
+			 *	Must not outlive the call it is made in, and must not be held across Remove() of its slot.
+			 */
+			class CLookup
+			{
+			public:
+				//! Look up the object in a slot. None is found if the slot number is out of range or the slot is free.
+				CLookup(CSlotTable& table, size_t slot) : users_(NULL), obj_(NULL)
+				{
+					if (slot < N)
+						Acquire(table, slot);
+				}
+
+				/*! Find the first object matching a predicate, by checking every slot.
+				 *	Takes time in proportion to the size of the table, so it is meant for rare events only.
+				 */
+				CLookup(CSlotTable& table, const std::function<bool(T*)>& pred) : users_(NULL), obj_(NULL)
+				{
+					for (size_t i = 0; i < N && !obj_; ++i)
+					{
+						Acquire(table, i);
+						if (obj_ && !pred(obj_))
+							Release();
+					}
+				}
+
+				~CLookup() { Release(); }
+
+				//! Get the object found, or NULL if none is.
+				T* Get() const { return obj_; }
+
+			private:
+				CLookup(const CLookup&);
+				CLookup& operator=(const CLookup&);
+
+				void Acquire(CSlotTable& table, size_t slot)
+				{
+					// Counted before loading the slot, so that Remove() either sees the count or the lookup sees NULL.
+					users_ = &table.users_[slot];
+					++*users_;
+					obj_ = table.slots_[slot].load();
+					if (!obj_)
+						Release();
+				}
+
+				void Release()
+				{
+					if (users_)
+						--*users_;
+					users_ = NULL;
+					obj_ = NULL;
+				}
+
+				std::atomic<int>* users_;
+				T* obj_;
+			};
+
+			CSlotTable()
+			{
+				for (size_t i = 0; i < N; ++i)
+				{
+					slots_[i] = NULL;
+					users_[i] = 0;
+				}
+			}
+
+			/*! Put an object into a free slot.
+			 *	@param[in]	obj	The object, not NULL.
+			 *	@return			The slot number, or -1 if the table is full.
+			 */
+			int Add(T* obj)
+			{
+				for (size_t i = 0; i < N; ++i)
+				{
+					T* expected = NULL;
+					if (slots_[i].compare_exchange_strong(expected, obj))
+						return int(i);
+				}
+				return -1;
+			}
+
+			/*! Free a slot, once no lookup uses its object any more.
+			 *	The object may be destroyed as soon as this returns.
+			 *	Must not be called while the calling thread holds a lookup of the slot.
+			 *	@param[in]	slot	The slot number returned by Add(), or -1 for none.
+			 */
+			void Remove(int slot)
+			{
+				if (slot < 0 || size_t(slot) >= N)
+					return;
+				slots_[slot] = NULL;
+				// Lookups starting from now find the slot free, and those under way are short.
+				while (users_[slot].load() != 0)
+					std::this_thread::yield();
+			}
+
+		private:
+			std::atomic<T*> slots_[N];
+			//! Number of lookups under way on each slot.
+			std::atomic<int> users_[N];
+		};
+	}
+}
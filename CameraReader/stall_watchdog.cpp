@@ -0,0 +1,77 @@
+#include <chrono>
+
+#include <CameraReader/CameraReader/stall_watchdog.hpp>
+
+using namespace std;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		shared_ptr<CStallWatchdog> CStallWatchdog::Acquire()
+		{
+			static mutex shared_lock;
+			static weak_ptr<CStallWatchdog> shared;
+
+			lock_guard<mutex> guard(shared_lock);
+			shared_ptr<CStallWatchdog> watchdog = shared.lock();
+			if (!watchdog)
+			{
+				watchdog = make_shared<CStallWatchdog>();
+				shared = watchdog;
+			}
+			return watchdog;
+		}
+
+		CStallWatchdog::CStallWatchdog(int period_ms) : period_ms_(period_ms), next_check_id_(0), stopping_(false)
+		{
+			runner_ = thread([this] { Run(); });
+		}
+
+		CStallWatchdog::~CStallWatchdog()
+		{
+			{
+				lock_guard<mutex> guard(lock_);
+				stopping_ = true;
+			}
+			stop_.notify_one();
+			runner_.join();
+		}
+
+		int CStallWatchdog::Add(const Check& check)
+		{
+			lock_guard<mutex> guard(checks_lock_);
+			checks_.push_back(make_pair(++next_check_id_, check));
+			return next_check_id_;
+		}
+
+		void CStallWatchdog::Remove(int id)
+		{
+			lock_guard<mutex> guard(checks_lock_);
+			for (auto it = checks_.begin(); it != checks_.end(); ++it)
+			{
+				if (it->first == id)
+				{
+					checks_.erase(it);
+					break;
+				}
+			}
+		}
+
+		void CStallWatchdog::Run()
+		{
+			for (;;)
+			{
+				{
+					unique_lock<mutex> guard(lock_);
+					if (stop_.wait_for(guard, chrono::milliseconds(period_ms_), [this] { return stopping_; }))
+						return;
+				}
+
+				lock_guard<mutex> guard(checks_lock_);
+				for (auto& check : checks_)
+					check.second();
+			}
+		}
+	}
+}
@@ -0,0 +1,96 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file stall_watchdog.hpp
+ *	@brief Periodic health checks of the readers of a process.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Theia
+{
+	namespace Camera
+	{
+		/*!	@class CStallWatchdog
+		 *	@brief Runs the freshness checks of all watched readers on one background thread.
+		 *
+		 *	Checks run one after another every period, so a reader being recovered delays the checks of the others,
+		 *	but never its own capture or decode threads.
+		 *	All readers share one watchdog, which lives as long as any of them holds it.
+		 */
+		class CStallWatchdog
+		{
+		public:
+			//! Check run on the watchdog thread each period.
+			typedef std::function<void()> Check;
+
+			/*! Get the shared watchdog, starting its thread if nobody holds it.
+			 *	@return	The watchdog, stopped once the last holder releases it.
+			 */
+			static std::shared_ptr<CStallWatchdog> Acquire();
+
+			/*! Constructor of CStallWatchdog.
+			 *	@param[in]	period_ms	How often the checks run.
+			 */
+			explicit CStallWatchdog(int period_ms = 100);
+			~CStallWatchdog();
+
+			/*! Register a check.
+			 *	@return	An ID for Remove().
+			 */
+			int Add(const Check& check);
+
+			/*! Remove a check.
+			 *	Once this returns, the check is not running and will not be called again.
+			 *	Must not be called from a check.
+			 */
+			void Remove(int id);
+
+			//! Get how often the checks run, in milliseconds.
+			int GetPeriodMs() const { return period_ms_; }
+
+		private:
+			//! Run the checks every period until stopped.
+			void Run();
+
+			const int period_ms_;
+
+			//! Held while the checks run, so that Remove() waits for a running check.
+			std::mutex checks_lock_;
+			std::vector<std::pair<int, Check> > checks_;
+			int next_check_id_;
+
+			std::thread runner_;
+			//! Guards stopping_ against the wait of runner_.
+			std::mutex lock_;
+			std::condition_variable stop_;
+			bool stopping_;
+		};
+	}
+}
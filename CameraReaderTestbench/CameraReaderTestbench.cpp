@@ -18,7 +18,10 @@ int main(int argc, char* argv[])
 	while (true)
 	{
 		img = camera.GetImage();
-		
+		// No frame came within the frame timeout, e.g. while the camera reconnects.
+		if (img.empty())
+			continue;
+
 		cv::resize(img, img, cv::Size(img.cols >> 1, img.rows >> 1));
 
 		cv::imshow("Web Camera", img);
@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <vector>
+
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+
+namespace Theia
+{
+	namespace Camera
+	{
+		namespace Test
+		{
+			struct TestCase
+			{
+				const char* name;
+				void (*run)();
+			};
+
+			//! The registered tests, constructed on first use as registrars run during static initialization.
+			vector<TestCase>& Tests()
+			{
+				static vector<TestCase> tests;
+				return tests;
+			}
+
+			//! Failed checks of the running test.
+			int g_failures = 0;
+
+			void Fail(const char* expr, const char* file, int line)
+			{
+				fprintf(stderr, "%s(%d): CHECK(%s) failed\n", file, line, expr);
+				++g_failures;
+			}
+
+			CRegistrar::CRegistrar(const char* name, void (*test)())
+			{
+				TestCase test_case = { name, test };
+				Tests().push_back(test_case);
+			}
+		}
+	}
+}
+
+using namespace Theia::Camera::Test;
+
+int main(int argc, char* argv[])
+{
+	int failed = 0;
+	for (auto& test : Tests())
+	{
+		g_failures = 0;
+		test.run();
+		printf("%-48s %s\n", test.name, g_failures ? "FAILED" : "ok");
+		if (g_failures)
+			++failed;
+	}
+	printf("%d of %d tests failed.\n", failed, (int)Tests().size());
+	return failed ? 1 : 0;
+}
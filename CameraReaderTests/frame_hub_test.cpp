@@ -0,0 +1,49 @@
+#include <thread>
+
+#include <CameraReader/CameraReader/frame_hub.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+//! Publish a frame tagged with the given source frame number.
+static void PublishFrame(CFrameHub& hub, long long frame_num)
+{
+	hub.BeginWrite().info.source_frame_num = frame_num;
+	hub.Publish();
+}
+
+TEST_CASE(FrameHubReadsNewerFrames)
+{
+	CFrameHub hub;
+	Frame frame;
+	unsigned long long seq = 0;
+	CHECK(!hub.ReadNewer(0, frame, &seq, 0));
+
+	PublishFrame(hub, 10);
+	PublishFrame(hub, 11);
+	CHECK(hub.ReadNewer(0, frame, &seq, 0));
+	CHECK(seq == 2 && frame.info.source_frame_num == 11);
+	// Nothing newer than the last frame read.
+	CHECK(!hub.ReadNewer(seq, frame, &seq, 10));
+}
+
+TEST_CASE(FrameHubResetRestartsSequence)
+{
+	CFrameHub hub;
+	for (int i = 0; i < 3; ++i)
+		PublishFrame(hub, i);
+	hub.Close();
+	hub.Reset();
+	CHECK(hub.GetSequence() == 0);
+
+	// A reader that forgot its sequence number waits for the first frame published after the reset.
+	Frame frame;
+	unsigned long long seq = 0;
+	bool got_frame = false;
+	thread reader([&] { got_frame = hub.ReadNewer(0, frame, &seq); });
+	PublishFrame(hub, 100);
+	reader.join();
+	CHECK(got_frame);
+	CHECK(seq == 1 && frame.info.source_frame_num == 100);
+}
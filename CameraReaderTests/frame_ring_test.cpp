@@ -0,0 +1,143 @@
+#include <chrono>
+#include <thread>
+
+#include <CameraReader/CameraReader/frame_ring.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+TEST_CASE(FrameRingWrapsAround)
+{
+	CFrameRing<int> ring;
+	ring.Reset(3, DROP_OLDEST);
+	int next_pushed = 0, next_popped = 0;
+	CHECK(ring.Push(next_pushed++));
+	// Head and tail advance by 2 per round, so they wrap at every position of the 3 slots, and the ring never overflows.
+	for (int round = 0; round < 10; ++round)
+	{
+		for (int i = 0; i < 2; ++i)
+			CHECK(ring.Push(next_pushed++));
+		CHECK(ring.GetStats().size == 3);
+		for (int i = 0; i < 2; ++i)
+		{
+			int frame = -1;
+			CHECK(ring.Pop(frame, 0));
+			CHECK(frame == next_popped++);
+		}
+	}
+	const FrameRingStats stats = ring.GetStats();
+	CHECK(stats.size == 1);
+	CHECK(stats.dropped_oldest == 0);
+}
+
+TEST_CASE(FrameRingDropsOldest)
+{
+	CFrameRing<int> ring;
+	ring.Reset(3, DROP_OLDEST);
+	for (int i = 1; i <= 5; ++i)
+		CHECK(ring.Push(i));
+	int frame;
+	for (int expected = 3; expected <= 5; ++expected)
+	{
+		CHECK(ring.Pop(frame, 0));
+		CHECK(frame == expected);
+	}
+	const FrameRingStats stats = ring.GetStats();
+	CHECK(stats.pushed == 5);
+	CHECK(stats.popped == 3);
+	CHECK(stats.dropped_oldest == 2);
+	CHECK(stats.dropped_newest == 0);
+}
+
+TEST_CASE(FrameRingDropsNewest)
+{
+	CFrameRing<int> ring;
+	ring.Reset(3, DROP_NEWEST);
+	for (int i = 1; i <= 3; ++i)
+		CHECK(ring.Push(i));
+	CHECK(!ring.Push(4));
+	CHECK(!ring.Push(5));
+	int frame;
+	for (int expected = 1; expected <= 3; ++expected)
+	{
+		CHECK(ring.Pop(frame, 0));
+		CHECK(frame == expected);
+	}
+	const FrameRingStats stats = ring.GetStats();
+	CHECK(stats.dropped_newest == 2);
+	CHECK(stats.dropped_oldest == 0);
+}
+
+TEST_CASE(FrameRingBlocksProducer)
+{
+	CFrameRing<int> ring;
+	ring.Reset(1, BLOCK_PRODUCER);
+	CHECK(ring.Push(1));
+	bool pushed = false;
+	thread producer([&] { pushed = ring.Push(2); });
+	this_thread::sleep_for(chrono::milliseconds(50));
+	CHECK(ring.GetStats().producer_waits == 1);
+	int frame;
+	CHECK(ring.Pop(frame, 0));
+	CHECK(frame == 1);
+	producer.join();
+	CHECK(pushed);
+	CHECK(ring.Pop(frame, 0));
+	CHECK(frame == 2);
+}
+
+TEST_CASE(FrameRingEmptyAndDisabled)
+{
+	CFrameRing<int> ring;
+	int frame;
+	// A ring never configured has no capacity, and refuses every frame.
+	CHECK(!ring.Push(1));
+	CHECK(!ring.Pop(frame, 0));
+	CHECK(ring.GetCapacity() == 0);
+
+	ring.Reset(2, DROP_OLDEST);
+	const auto start = chrono::steady_clock::now();
+	CHECK(!ring.Pop(frame, 20));
+	CHECK(chrono::steady_clock::now() - start >= chrono::milliseconds(15));
+
+	// Reconfiguring discards the queued frames.
+	CHECK(ring.Push(1));
+	ring.Reset(2, DROP_OLDEST);
+	CHECK(!ring.Pop(frame, 0));
+	CHECK(ring.GetStats().pushed == 0);
+}
+
+TEST_CASE(FrameRingCloseWakesConsumer)
+{
+	CFrameRing<int> ring;
+	ring.Reset(2, BLOCK_PRODUCER);
+	bool popped = true;
+	thread consumer([&] { int frame; popped = ring.Pop(frame); });
+	this_thread::sleep_for(chrono::milliseconds(20));
+	ring.Close();
+	consumer.join();
+	CHECK(!popped);
+	CHECK(!ring.Push(1));
+}
+
+TEST_CASE(FrameRingConcurrentProducerConsumer)
+{
+	const int frame_cnt = 100000;
+	CFrameRing<int> ring;
+	ring.Reset(8, BLOCK_PRODUCER);
+	thread producer([&]
+	{
+		for (int i = 0; i < frame_cnt; ++i)
+			ring.Push(i);
+	});
+	int expected = 0;
+	bool in_order = true;
+	int frame;
+	while (expected < frame_cnt && ring.Pop(frame, 1000))
+		in_order &= frame == expected++;
+	producer.join();
+	CHECK(in_order);
+	CHECK(expected == frame_cnt);
+	CHECK(ring.GetStats().popped == frame_cnt);
+}
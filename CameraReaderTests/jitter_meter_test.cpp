@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET Socket;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int Socket;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include <opencv2/core/core.hpp>
+
+#include <CameraReader/CameraReader/jitter_meter.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+//! Convert milliseconds to cv::getTickCount() ticks.
+static long long Ticks(double ms)
+{
+	return (long long)(ms * cv::getTickFrequency() / 1000);
+}
+
+TEST_CASE(JitterMeterSteadyStream)
+{
+	CJitterMeter meter;
+	for (int i = 0; i < 100; ++i)
+		meter.Add(Ticks(1000 + i * 40), i * 40, 25);
+	CHECK(meter.GetLost() == 0);
+	CHECK(meter.GetJitterMs() < 0.01);
+}
+
+TEST_CASE(JitterMeterCountsLostFrames)
+{
+	CJitterMeter meter;
+	meter.Add(Ticks(0), 0, 25);
+	// Frames 1 and 2 never arrive.
+	meter.Add(Ticks(120), 120, 25);
+	CHECK(meter.GetLost() == 2);
+	// Without a frame rate, a gap is not counted.
+	meter.Add(Ticks(240), 240, 0);
+	CHECK(meter.GetLost() == 2);
+	// A time stamp going back is a restart of the stream, not a loss.
+	meter.Add(Ticks(280), 0, 25);
+	meter.Add(Ticks(320), 40, 25);
+	CHECK(meter.GetLost() == 2);
+}
+
+TEST_CASE(JitterMeterConvergesToJitter)
+{
+	// Frames arrive alternately 10 ms late and on time, so the transit time changes by 10 ms every frame.
+	CJitterMeter meter;
+	for (int i = 0; i < 400; ++i)
+		meter.Add(Ticks(i * 40 + (i & 1) * 10), i * 40, 25);
+	CHECK(meter.GetJitterMs() > 9 && meter.GetJitterMs() < 10.01);
+	CHECK(meter.GetLost() == 0);
+}
+
+TEST_CASE(JitterMeterResetForgetsEverything)
+{
+	CJitterMeter meter;
+	for (int i = 0; i < 100; ++i)
+		meter.Add(Ticks(i * 40 + (i & 1) * 10), i * 80, 25);
+	CHECK(meter.GetLost() > 0);
+	CHECK(meter.GetJitterMs() > 0);
+
+	meter.Reset();
+	CHECK(meter.GetLost() == 0);
+	CHECK(meter.GetJitterMs() == 0);
+	// The next frames are neither compared to the frames before the reset, nor smoothed with their jitter.
+	meter.Add(Ticks(10000), 8000, 25);
+	meter.Add(Ticks(10040), 8040, 25);
+	CHECK(meter.GetLost() == 0);
+	CHECK(meter.GetJitterMs() == 0);
+}
+
+/*!	Stand-in for a camera streaming over UDP: sends the time stamp of each frame to a loopback port,
+ *	drops every tenth frame, and delays the others by up to max_delay_ms.
+ *	@return The number of frames dropped.
+ */
+static int SendLoopbackStream(Socket sock, const sockaddr_in& to, int frame_cnt, int interval_ms, int max_delay_ms)
+{
+	mt19937 rng(12345);
+	uniform_int_distribution<int> delay(0, max_delay_ms);
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int dropped = 0;
+	for (int i = 0; i < frame_cnt; ++i)
+	{
+		// Never drop the last frame, which would go uncounted.
+		if (i % 10 == 5 && i != frame_cnt - 1)
+		{
+			++dropped;
+			continue;
+		}
+		this_thread::sleep_until(start + chrono::milliseconds(i * interval_ms + delay(rng)));
+		const long long stamp_ms = (long long)i * interval_ms;
+		char packet[sizeof(stamp_ms)];
+		memcpy(packet, &stamp_ms, sizeof(stamp_ms));
+		sendto(sock, packet, sizeof(packet), 0, (const sockaddr*)&to, sizeof(to));
+	}
+	return dropped;
+}
+
+TEST_CASE(JitterMeterLoopbackStream)
+{
+#ifdef WIN32
+	WSADATA wsa_data;
+	CHECK(WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0);
+#endif
+	const int frame_cnt = 100, interval_ms = 10, max_delay_ms = 4;
+
+	Socket receiver = socket(AF_INET, SOCK_DGRAM, 0);
+	Socket sender = socket(AF_INET, SOCK_DGRAM, 0);
+	CHECK(receiver != INVALID_SOCKET && sender != INVALID_SOCKET);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	CHECK(bind(receiver, (const sockaddr*)&addr, sizeof(addr)) == 0);
+	socklen_t addr_len = sizeof(addr);
+	CHECK(getsockname(receiver, (sockaddr*)&addr, &addr_len) == 0);
+	// Give up on a lost datagram rather than hang the tests.
+#ifdef WIN32
+	DWORD recv_timeout = 1000;
+#else
+	timeval recv_timeout = { 1, 0 };
+#endif
+	setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, (const char*)&recv_timeout, sizeof(recv_timeout));
+
+	int dropped = 0;
+	thread camera([&] { dropped = SendLoopbackStream(sender, addr, frame_cnt, interval_ms, max_delay_ms); });
+
+	CJitterMeter meter;
+	long long last_stamp_ms = -1;
+	while (last_stamp_ms != (long long)(frame_cnt - 1) * interval_ms)
+	{
+		char packet[sizeof(long long)];
+		if (recv(receiver, packet, sizeof(packet), 0) != (int)sizeof(packet))
+			break;
+		memcpy(&last_stamp_ms, packet, sizeof(last_stamp_ms));
+		meter.Add((long long)cv::getTickCount(), (double)last_stamp_ms, 1000. / interval_ms);
+	}
+	camera.join();
+	closesocket(sender);
+	closesocket(receiver);
+#ifdef WIN32
+	WSACleanup();
+#endif
+
+	CHECK(last_stamp_ms == (long long)(frame_cnt - 1) * interval_ms);
+	CHECK(meter.GetLost() == (unsigned long long)dropped);
+	// The sender delays frames by up to max_delay_ms, so the transit time changes by at most that much,
+	// give or take the scheduling of the two threads.
+	CHECK(meter.GetJitterMs() > 0);
+	CHECK(meter.GetJitterMs() < max_delay_ms + 5);
+}
@@ -0,0 +1,97 @@
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <CameraReader/CameraReader/latency_histogram.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+namespace
+{
+	//! The median of a histogram holding the single given duration in microseconds.
+	double MedianOfOne(double us)
+	{
+		CLatencyHistogram histogram;
+		histogram.Record(us / 1000);
+		return histogram.GetStats(1).p50_ms * 1000;
+	}
+}
+
+TEST_CASE(LatencyHistogramBucketBoundaries)
+{
+	// Below 8 us, each microsecond has a bucket of its own.
+	CHECK(MedianOfOne(0) == 0.5);
+	CHECK(MedianOfOne(5) == 5.5);
+	CHECK(MedianOfOne(7) == 7.5);
+	// From 8 us on, buckets are 1/8 of a power of two wide: [8, 9), ..., [15, 16), then [16, 18), [18, 20) and so on.
+	CHECK(MedianOfOne(8) == 8.5);
+	CHECK(MedianOfOne(15) == 15.5);
+	CHECK(MedianOfOne(16) == 17);
+	CHECK(MedianOfOne(17) == 17);
+	CHECK(MedianOfOne(18) == 19);
+	CHECK(MedianOfOne(31) == 31);
+	CHECK(MedianOfOne(32) == 34);
+}
+
+TEST_CASE(LatencyHistogramRelativeError)
+{
+	bool within = true;
+	for (double us = 8; us < 1e10; us *= 1.07)
+		within &= fabs(MedianOfOne(floor(us)) - floor(us)) <= floor(us) / 8;
+	CHECK(within);
+
+	// Durations beyond the last bucket are clamped into it, but still counted exactly in the maximum.
+	CLatencyHistogram histogram;
+	histogram.Record(1e12);
+	const StageStats stats = histogram.GetStats(1);
+	CHECK(stats.count == 1);
+	CHECK(stats.p99_ms > 0);
+	CHECK(stats.max_ms == 1e12);
+}
+
+TEST_CASE(LatencyHistogramPercentiles)
+{
+	CLatencyHistogram histogram;
+	StageStats stats = histogram.GetStats(1);
+	CHECK(stats.count == 0);
+	CHECK(stats.p50_ms == 0);
+	CHECK(stats.mean_ms == 0);
+
+	for (int ms = 1; ms <= 100; ++ms)
+		histogram.Record(ms);
+	stats = histogram.GetStats(2);
+	CHECK(stats.count == 100);
+	CHECK(stats.per_sec == 50);
+	CHECK(fabs(stats.mean_ms - 50.5) < 1e-9);
+	CHECK(stats.max_ms == 100);
+	CHECK(fabs(stats.p50_ms - 50) <= 50. / 8);
+	CHECK(fabs(stats.p90_ms - 90) <= 90. / 8);
+	CHECK(fabs(stats.p99_ms - 99) <= 99. / 8);
+	CHECK(stats.p50_ms <= stats.p90_ms && stats.p90_ms <= stats.p99_ms && stats.p99_ms <= stats.max_ms * 9 / 8);
+
+	histogram.Reset();
+	stats = histogram.GetStats(1);
+	CHECK(stats.count == 0);
+	CHECK(stats.max_ms == 0);
+}
+
+TEST_CASE(LatencyHistogramConcurrentRecording)
+{
+	const int thread_cnt = 4, record_cnt = 50000;
+	CLatencyHistogram histogram;
+	vector<thread> threads;
+	for (int i = 0; i < thread_cnt; ++i)
+		threads.push_back(thread([&histogram, i]
+		{
+			for (int j = 0; j < record_cnt; ++j)
+				histogram.Record(i + 1);
+		}));
+	for (auto& t : threads)
+		t.join();
+	const StageStats stats = histogram.GetStats(1);
+	CHECK(stats.count == thread_cnt * record_cnt);
+	CHECK(fabs(stats.mean_ms - 2.5) < 1e-9);
+	CHECK(stats.max_ms == thread_cnt);
+}
@@ -0,0 +1,149 @@
+#include <thread>
+#include <vector>
+
+#include <CameraReader/CameraReader/packet_queue.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+namespace
+{
+	//! Fill a packet with bytes derived from its number, so that its contents can be checked on the other side.
+	vector<unsigned char> MakePacket(unsigned long num, size_t size)
+	{
+		vector<unsigned char> data(size);
+		for (size_t i = 0; i < size; ++i)
+			data[i] = (unsigned char)(num * 31 + i);
+		return data;
+	}
+
+	bool PacketMatches(const CPacketQueue::Packet& packet, unsigned long num, size_t size)
+	{
+		if (packet.type != num || packet.size != size)
+			return false;
+		const vector<unsigned char> expected = MakePacket(num, size);
+		return memcmp(packet.data, expected.data(), size) == 0;
+	}
+}
+
+TEST_CASE(PacketQueueEmpty)
+{
+	CPacketQueue queue(64, 4);
+	CPacketQueue::Packet packet;
+	CHECK(queue.Empty());
+	CHECK(!queue.Front(packet));
+
+	const vector<unsigned char> data = MakePacket(1, 10);
+	CHECK(queue.Push(1, data.data(), data.size()));
+	CHECK(!queue.Empty());
+	CHECK(queue.Front(packet));
+	CHECK(PacketMatches(packet, 1, 10));
+	// Front() does not remove the packet.
+	CHECK(queue.Front(packet));
+	queue.Pop();
+	CHECK(queue.Empty());
+	CHECK(!queue.Front(packet));
+}
+
+TEST_CASE(PacketQueueDropsWhenSlotsAreFull)
+{
+	CPacketQueue queue(1024, 3);
+	const vector<unsigned char> data = MakePacket(0, 8);
+	for (int i = 0; i < 3; ++i)
+		CHECK(queue.Push(i, data.data(), data.size()));
+	CHECK(!queue.Push(3, data.data(), data.size()));
+	CHECK(queue.GetPushed() == 3);
+	CHECK(queue.GetDropped() == 1);
+
+	queue.Pop();
+	CHECK(queue.Push(4, data.data(), data.size()));
+	CHECK(queue.GetDropped() == 1);
+}
+
+TEST_CASE(PacketQueueDropsWhenArenaIsFull)
+{
+	CPacketQueue queue(100, 16);
+	const vector<unsigned char> data = MakePacket(0, 40);
+	CHECK(queue.Push(0, data.data(), 40));
+	CHECK(queue.Push(1, data.data(), 40));
+	// 80 of 100 bytes are taken.
+	CHECK(!queue.Push(2, data.data(), 40));
+	CHECK(queue.Push(3, data.data(), 20));
+	CHECK(!queue.Push(4, data.data(), 1));
+	CHECK(queue.GetDropped() == 2);
+}
+
+TEST_CASE(PacketQueueWrapsAround)
+{
+	CPacketQueue queue(100, 4);
+	CPacketQueue::Packet packet;
+	vector<unsigned char> data = MakePacket(0, 30);
+	CHECK(queue.Push(0, data.data(), 30));
+	CHECK(queue.Push(1, MakePacket(1, 30).data(), 30));
+	CHECK(queue.Push(2, MakePacket(2, 30).data(), 30));
+	queue.Pop();
+	queue.Pop();
+	// 10 bytes are left before the end of the arena, so the packet goes to its start to stay contiguous.
+	data = MakePacket(3, 30);
+	CHECK(queue.Push(3, data.data(), 30));
+	CHECK(queue.Front(packet));
+	CHECK(PacketMatches(packet, 2, 30));
+	queue.Pop();
+	CHECK(queue.Front(packet));
+	CHECK(PacketMatches(packet, 3, 30));
+
+	// Packet 3 and the 10 bytes skipped before it hold the arena until it is popped.
+	data = MakePacket(4, 70);
+	CHECK(!queue.Push(4, data.data(), 70));
+	queue.Pop();
+	CHECK(queue.Push(5, data.data(), 70));
+
+	// Many rounds move the slot indices and the arena position across their ends at every offset.
+	bool intact = true;
+	queue.Front(packet);
+	queue.Pop();
+	for (unsigned long num = 6; num < 200; ++num)
+	{
+		const size_t size = 1 + num % 45;
+		data = MakePacket(num, size);
+		intact &= queue.Push(num, data.data(), size);
+		intact &= queue.Front(packet) && PacketMatches(packet, num, size);
+		queue.Pop();
+	}
+	CHECK(intact);
+	CHECK(queue.Empty());
+}
+
+TEST_CASE(PacketQueueConcurrentProducerConsumer)
+{
+	const unsigned long packet_cnt = 200000;
+	CPacketQueue queue(4096, 64);
+	thread producer([&]
+	{
+		for (unsigned long num = 0; num < packet_cnt; ++num)
+		{
+			const vector<unsigned char> data = MakePacket(num, 1 + num % 200);
+			while (!queue.Push(num, data.data(), data.size()))
+				this_thread::yield();
+		}
+	});
+
+	bool intact = true;
+	CPacketQueue::Packet packet;
+	for (unsigned long num = 0; num < packet_cnt;)
+	{
+		if (!queue.Front(packet))
+		{
+			this_thread::yield();
+			continue;
+		}
+		intact &= PacketMatches(packet, num, 1 + num % 200);
+		queue.Pop();
+		++num;
+	}
+	producer.join();
+	CHECK(intact);
+	CHECK(queue.Empty());
+	CHECK(queue.GetPushed() == packet_cnt);
+}
@@ -0,0 +1,128 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <CameraReader/CameraReader/slot_table.hpp>
+#include <CameraReader/CameraReaderTests/test.hpp>
+
+using namespace std;
+using namespace Theia::Camera;
+
+//! Look up the object in a slot, and let the lookup go at once.
+template <typename T, size_t N>
+static T* Get(CSlotTable<T, N>& table, size_t slot)
+{
+	return typename CSlotTable<T, N>::CLookup(table, slot).Get();
+}
+
+TEST_CASE(SlotTableAddGetRemove)
+{
+	CSlotTable<int, 4> table;
+	int objs[5] = { 0, 1, 2, 3, 4 };
+	int slots[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		slots[i] = table.Add(&objs[i]);
+		CHECK(slots[i] >= 0 && slots[i] < 4);
+		CHECK(Get(table, slots[i]) == &objs[i]);
+	}
+	CHECK(table.Add(&objs[4]) == -1);
+
+	// A freed slot is taken again.
+	table.Remove(slots[2]);
+	CHECK(Get(table, slots[2]) == NULL);
+	CHECK(table.Add(&objs[4]) == slots[2]);
+	CHECK(Get(table, slots[2]) == &objs[4]);
+}
+
+TEST_CASE(SlotTableOutOfRange)
+{
+	CSlotTable<int, 2> table;
+	int obj = 0;
+	CHECK(Get(table, 0) == NULL);
+	CHECK(Get(table, 2) == NULL);
+	CHECK(Get(table, size_t(-1)) == NULL);
+	const int slot = table.Add(&obj);
+	// Removing no slot or a slot out of range changes nothing.
+	table.Remove(-1);
+	table.Remove(2);
+	CHECK(Get(table, slot) == &obj);
+}
+
+TEST_CASE(SlotTableFindIf)
+{
+	CSlotTable<int, 8> table;
+	int objs[3] = { 10, 20, 30 };
+	for (int i = 0; i < 3; ++i)
+		table.Add(&objs[i]);
+	{
+		CSlotTable<int, 8>::CLookup lookup(table, [](int* obj) { return *obj == 20; });
+		CHECK(lookup.Get() == &objs[1]);
+	}
+	{
+		CSlotTable<int, 8>::CLookup lookup(table, [](int* obj) { return *obj == 40; });
+		CHECK(lookup.Get() == NULL);
+	}
+}
+
+TEST_CASE(SlotTableRemoveWaitsForLookups)
+{
+	CSlotTable<int, 4> table;
+	int obj = 0;
+	const int slot = table.Add(&obj);
+	atomic<bool> removed(false);
+	thread remover;
+	{
+		CSlotTable<int, 4>::CLookup lookup(table, slot);
+		CHECK(lookup.Get() == &obj);
+		remover = thread([&]
+		{
+			table.Remove(slot);
+			removed = true;
+		});
+		this_thread::sleep_for(chrono::milliseconds(50));
+		// The object is still in use, so Remove() has not returned, while new lookups already find the slot free.
+		CHECK(!removed);
+		CHECK(Get(table, slot) == NULL);
+		CHECK(*lookup.Get() == 0);
+	}
+	remover.join();
+	CHECK(removed);
+
+	// A lookup by predicate keeps only the slot it found.
+	int objs[2] = { 1, 2 };
+	const int slots[2] = { table.Add(&objs[0]), table.Add(&objs[1]) };
+	{
+		CSlotTable<int, 4>::CLookup lookup(table, [](int* obj) { return *obj == 2; });
+		CHECK(lookup.Get() == &objs[1]);
+		table.Remove(slots[0]);
+	}
+	table.Remove(slots[1]);
+}
+
+TEST_CASE(SlotTableConcurrentAddRemove)
+{
+	const int thread_cnt = 4, round_cnt = 20000;
+	CSlotTable<int, 8> table;
+	vector<int> objs(thread_cnt);
+	atomic<bool> stolen(false);
+	vector<thread> threads;
+	for (int i = 0; i < thread_cnt; ++i)
+		threads.push_back(thread([&, i]
+		{
+			for (int round = 0; round < round_cnt; ++round)
+			{
+				const int slot = table.Add(&objs[i]);
+				// Each thread holds one slot at a time, so the table never fills, and no other thread takes the slot meanwhile.
+				if (slot < 0 || Get(table, slot) != &objs[i])
+					stolen = true;
+				table.Remove(slot);
+			}
+		}));
+	for (auto& t : threads)
+		t.join();
+	CHECK(!stolen);
+	for (size_t i = 0; i < 8; ++i)
+		CHECK(Get(table, i) == NULL);
+}
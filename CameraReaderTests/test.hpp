@@ -0,0 +1,62 @@
+/*!*****************************************************************************
+ * Copyright 2015-2017 Theia Corporation All Rights Reserved.
+ *
+ * The source code,  information  and material  ("Material") contained  herein is
+ * owned by Theia Corporation or its  suppliers or licensors,  and  title to such
+ * Material remains with Theia  Corporation or its  suppliers or  licensors.  The
+ * Material  contains  proprietary  information  of  Theia or  its suppliers  and
+ * licensors.  The Material is protected by  worldwide copyright  laws and treaty
+ * provisions.  No part  of  the  Material   may  be  used,  copied,  reproduced,
+ * modified, published,  uploaded, posted, transmitted,  distributed or disclosed
+ * in any way without Theia's prior express written permission.  No license under
+ * any patent,  copyright or other  intellectual property rights  in the Material
+ * is granted to  or  conferred  upon  you,  either   expressly,  by implication,
+ * inducement,  estoppel  or  otherwise.  Any  license   under such  intellectual
+ * property rights must be express and approved by Theia in writing.
+ *
+ * Unless otherwise agreed by Theia in writing,  you may not remove or alter this
+ * notice or  any  other  notice   embedded  in  Materials  by  Theia  or Theia's
+ * suppliers or licensors in any way.
+ *******************************************************************************/
+
+/*!	@file test.hpp
+ *	@brief Minimal test registry for the building blocks of CameraReader, which need no camera.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+/*!	@def CHECK
+ *	@brief Fail the running test if the expression is false, and go on with the test.
+ */
+#define CHECK(expr) ((expr) ? (void)0 : Theia::Camera::Test::Fail(#expr, __FILE__, __LINE__))
+
+/*!	@def TEST_CASE
+ *	@brief Define a test, which CameraReaderTests.cpp runs.
+ */
+#define TEST_CASE(name) \
+	static void name(); \
+	static Theia::Camera::Test::CRegistrar name##_registrar(#name, name); \
+	static void name()
+
+namespace Theia
+{
+	namespace Camera
+	{
+		namespace Test
+		{
+			//! Report a failed check of the running test.
+			void Fail(const char* expr, const char* file, int line);
+
+			/*!	@class CRegistrar
+			 *	@brief Adds a test to the list run by main(), from the static initialization of its file.
+			 */
+			class CRegistrar
+			{
+			public:
+				CRegistrar(const char* name, void (*test)());
+			};
+		}
+	}
+}
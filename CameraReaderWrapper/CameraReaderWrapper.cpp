@@ -133,7 +133,18 @@ namespace Theia
 		{
 			try
 			{
-				m_pCameraReader = new CUSBCamReader(usb_camera_device);
+				CUSBCamReader* reader = new CUSBCamReader(usb_camera_device);
+				try
+				{
+					// The reader warms up in the background; fail here if the device cannot be opened.
+					reader->WaitWarmUp();
+				}
+				catch (...)
+				{
+					delete reader;
+					throw;
+				}
+				m_pCameraReader = reader;
 			}
 			catch (const std::exception& e)
 			{